@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+#       bench/ctTiers.sh
+#   Compares the latency of running compile-time functions in the IR
+#   interpreter against running them with the JIT, for compile-time
+#   functions of increasing size.  The tier is forced with ANTE_CT_TIER,
+#   and ![ct_impure] keeps the ct cache from skipping the work.
+#
+#   usage: bench/ctTiers.sh [path/to/ante]
+#
+ANTE=$(cd "$(dirname "${1:-./ante}")" && pwd)/$(basename "${1:-./ante}")
+SIZES="1 10 50 100 500 1000 5000"
+RUNS=5
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+
+# genCtFn <statements>
+#   Writes ctfn.an, containing a compile-time function with the given
+#   number of statements, and an empty main.
+genCtFn(){
+    {
+        echo "![ct_impure]"
+        echo "fun work:"
+        echo "    var x = 0"
+        i=0
+        while [ $i -lt "$1" ]; do
+            echo "    x += $i * 3 % 7"
+            i=$((i+1))
+        done
+        echo '    printf "%d\n" x'
+        echo
+        echo "work ()"
+    } > ctfn.an
+}
+
+# timeTier <tier>
+#   Prints the average time in ms of compiling ctfn.an with the given tier.
+timeTier(){
+    total=0
+    run=0
+    while [ $run -lt $RUNS ]; do
+        start=$(date +%s%N)
+        ANTE_CT_TIER=$1 "$ANTE" -c ctfn.an > /dev/null
+        end=$(date +%s%N)
+        total=$((total + (end - start) / 1000))
+        run=$((run+1))
+    done
+    echo "$total $RUNS" | awk '{printf "%.2f", $1 / $2 / 1000}'
+}
+
+printf "%10s %12s %12s\n" "statements" "interp (ms)" "jit (ms)"
+for n in $SIZES; do
+    genCtFn "$n"
+    printf "%10s %12s %12s\n" "$n" "$(timeTier interp)" "$(timeTier jit)"
+done
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+#       bench/incremental.sh
+#   Measures rebuild times after editing a single function in files with
+#   an increasing number of functions.  The object cache is bypassed by
+#   changing main on every build, so only the function-level cache in
+#   .antecache/fn can skip work.
+#
+#   usage: bench/incremental.sh [path/to/ante]
+#
+ANTE=$(cd "$(dirname "${1:-./ante}")" && pwd)/$(basename "${1:-./ante}")
+SIZES="10 100 500 1000 2000"
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+
+# genFile <functions> <edit>
+#   Writes fns.an with the given number of functions, each called from main.
+#   The first function and main both depend on edit.
+genFile(){
+    {
+        echo "fun f0: i32 x -> i32"
+        echo "    x * $2"
+        echo
+        i=1
+        while [ $i -lt "$1" ]; do
+            echo "fun f$i: i32 x -> i32"
+            echo "    f$((i-1)) x + $i"
+            echo
+            i=$((i+1))
+        done
+        echo "printf \"%d %d\\n\" (f$(($1-1)) 1) $2"
+    } > fns.an
+}
+
+# timeBuild
+#   Prints the time in ms taken to compile fns.an
+timeBuild(){
+    start=$(date +%s%N)
+    "$ANTE" -c fns.an > /dev/null
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+printf "%10s %12s %12s %12s\n" "functions" "clean (ms)" "leaf (ms)" "root (ms)"
+for n in $SIZES; do
+    rm -rf .antecache
+    genFile "$n" 1
+    clean=$(timeBuild)
+
+    #editing f0 invalidates only f0, as the signatures of its callers are unchanged
+    genFile "$n" 2
+    leaf=$(timeBuild)
+
+    #editing only main reuses every function
+    sed -i 's/) 2$/) 3/' fns.an
+    root=$(timeBuild)
+
+    printf "%10s %12s %12s %12s\n" "$n" "$clean" "$leaf" "$root"
+done
@@ -0,0 +1,311 @@
+/*
+ *      bench/micro/micro.cpp
+ *  Microbenchmarks of the compiler's hot internal functions, built with
+ *  make microbench.  Each benchmark is calibrated to run for about
+ *  SAMPLE_MS per sample, warmed up with one discarded sample, and then
+ *  timed over NUM_SAMPLES samples with a monotonic clock.  The median is
+ *  reported as it is the least sensitive to interference from the rest of
+ *  the system.
+ *
+ *  usage: microbench [--json] [filter]
+ *  Only benchmarks whose names contain filter are run.  --json prints
+ *  the results as json rather than as a table.
+ */
+#include "compiler.h"
+#include "yyparser.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#define SAMPLE_MS 50
+#define NUM_SAMPLES 15
+
+using namespace ante;
+
+typedef chrono::steady_clock Clock;
+
+/* Defined in src/compiler.cpp */
+string mangle(string& base, TypeNode *paramTys);
+
+
+/*
+ *  Prevents the compiler from optimizing away the computation of v.
+ */
+template<typename T>
+inline void keep(T &&v){
+    asm volatile("" : : "r"(&v) : "memory");
+}
+
+
+struct BenchResult {
+    string name;
+    unsigned long iterations;
+
+    //bytes processed per iteration, or 0 if not applicable
+    size_t bytes;
+
+    double medianNs, minNs, meanNs, stddevNs;
+};
+
+
+/*
+ *  Returns the time in ns taken to run the benchmark for the given number of iterations.
+ */
+double timeIterations(function<void(unsigned long)> &bench, unsigned long iterations){
+    auto start = Clock::now();
+    bench(iterations);
+    return chrono::duration<double, nano>(Clock::now() - start).count();
+}
+
+
+/*
+ *  Runs a benchmark, where bench(n) runs the measured operation n times.
+ */
+BenchResult runBenchmark(const string &name, function<void(unsigned long)> bench, size_t bytes = 0){
+    BenchResult res;
+    res.name = name;
+    res.bytes = bytes;
+
+    //double the iterations until a sample is long enough to time accurately, then scale to SAMPLE_MS
+    unsigned long iterations = 1;
+    double ns;
+    while((ns = timeIterations(bench, iterations)) < SAMPLE_MS * 1e5)
+        iterations *= 2;
+
+    iterations = max(1ul, (unsigned long)(iterations * (SAMPLE_MS * 1e6 / ns)));
+    res.iterations = iterations;
+
+    timeIterations(bench, iterations);
+
+    vector<double> samples;
+    for(int i = 0; i < NUM_SAMPLES; i++)
+        samples.push_back(timeIterations(bench, iterations) / iterations);
+
+    std::sort(samples.begin(), samples.end());
+    res.medianNs = samples[NUM_SAMPLES / 2];
+    res.minNs = samples[0];
+
+    double sum = 0, sqSum = 0;
+    for(double s : samples) sum += s;
+    res.meanNs = sum / NUM_SAMPLES;
+    for(double s : samples) sqSum += (s - res.meanNs) * (s - res.meanNs);
+    res.stddevNs = sqrt(sqSum / NUM_SAMPLES);
+    return res;
+}
+
+
+//only benchmarks whose names contain this are run
+string filter;
+
+void addBenchmark(vector<BenchResult> &results, const string &name, function<void(unsigned long)> bench, size_t bytes = 0){
+    if(name.find(filter) != string::npos)
+        results.push_back(runBenchmark(name, bench, bytes));
+}
+
+
+/*
+ *  Returns the source of a program with the given number of small functions.
+ */
+string genSource(int fns){
+    string src;
+    for(int i = 0; i < fns; i++){
+        src += "fun f" + to_string(i) + ": i32 x, [c8] s -> i32\n";
+        src += "    let y = x * " + to_string(i) + " + 3\n";
+        src += "    if y > 10 then printf \"%d %s\\n\" y s\n";
+        src += "    y\n\n";
+    }
+    src += "print (f0 1 \"main\".cStr)\n";
+    return src;
+}
+
+
+TypeNode* mkPtrTypeNode(TypeTag elem){
+    auto *ptr = mkAnonTypeNode(TT_Ptr);
+    ptr->extTy.reset(mkAnonTypeNode(elem));
+    return ptr;
+}
+
+
+/*
+ *  Returns the type i32, f64, [c8], (u8, i64).  Each element is also
+ *  linked to the next, so it doubles as a list of parameter types.
+ */
+TypeNode* mkTupleTypeNode(){
+    auto *tup = mkAnonTypeNode(TT_Tuple);
+    auto *i = mkAnonTypeNode(TT_I32);
+    auto *f = mkAnonTypeNode(TT_F64);
+    auto *s = mkPtrTypeNode(TT_C8);
+    auto *inner = mkAnonTypeNode(TT_Tuple);
+    inner->extTy.reset(mkAnonTypeNode(TT_U8));
+    inner->extTy->next.reset(mkAnonTypeNode(TT_I64));
+
+    tup->extTy.reset(i);
+    i->next.reset(f);
+    f->next.reset(s);
+    s->next.reset(inner);
+    return tup;
+}
+
+
+void benchLexer(vector<BenchResult> &results){
+    string src = genSource(200);
+    addBenchmark(results, "Lexer::next (200 fns)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++){
+            Lexer l{"bench", src};
+            yy::location loc;
+            loc.initialize();
+            while(int tok = l.next(&loc))
+                keep(tok);
+        }
+    }, src.length());
+}
+
+
+void benchParser(vector<BenchResult> &results){
+    string src = genSource(200);
+    addBenchmark(results, "parse (200 fns)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++){
+            setLexer(new Lexer("bench", src));
+            yy::parser p{};
+            p.parse();
+            delete parser::getRootNode();
+            delete yylexer;
+            yylexer = nullptr;
+        }
+    }, src.length());
+}
+
+
+void benchLookup(vector<BenchResult> &results, Compiler &c){
+    //variables are declared in the outermost scope, then looked up from 8 scopes deeper
+    auto *tv = new TypedValue(nullptr, mkAnonTypeNode(TT_I32));
+    unsigned int outer = c.scope;
+    for(int i = 0; i < 100; i++){
+        string name = "v" + to_string(i);
+        c.stoVar(name, new Variable(name, tv, outer));
+    }
+    for(int i = 0; i < 8; i++)
+        c.enterNewScope();
+
+    addBenchmark(results, "Compiler::lookup (8 scopes deep)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++)
+            keep(c.lookup("v50"));
+    });
+
+    addBenchmark(results, "Compiler::lookup (miss)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++)
+            keep(c.lookup("undefined"));
+    });
+
+    auto *var = new Variable("local", tv, c.scope);
+    addBenchmark(results, "Compiler::stoVar", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++)
+            c.stoVar("local", var);
+    });
+
+    for(int i = 0; i < 8; i++)
+        c.exitScope();
+}
+
+
+void benchTypes(vector<BenchResult> &results, Compiler &c){
+    unique_ptr<TypeNode> tup{mkTupleTypeNode()};
+    unique_ptr<TypeNode> tupCopy{deepCopyTypeNode(tup.get())};
+
+    addBenchmark(results, "typeNodeToLlvmType (tuple)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++)
+            keep(c.typeNodeToLlvmType(tup.get()));
+    });
+
+    addBenchmark(results, "deepCopyTypeNode (tuple)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++)
+            delete deepCopyTypeNode(tup.get());
+    });
+
+    addBenchmark(results, "TypeNode::operator== (tuple)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++)
+            keep(*tup == *tupCopy);
+    });
+
+    addBenchmark(results, "mangle (4 params)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++){
+            string name = "function";
+            keep(mangle(name, tup->extTy.get()));
+        }
+    });
+}
+
+
+void benchImplicitConversion(vector<BenchResult> &results, Compiler &c){
+    auto *fn = Function::Create(FunctionType::get(Type::getVoidTy(getGlobalContext()), false),
+            Function::ExternalLinkage, "bench", c.module.get());
+    c.builder.SetInsertPoint(BasicBlock::Create(getGlobalContext(), "entry", fn));
+
+    auto *i32 = new TypedValue(c.builder.getInt32(3), mkAnonTypeNode(TT_I32));
+    auto *i64 = new TypedValue(c.builder.getInt64(5), mkAnonTypeNode(TT_I64));
+    auto *f64 = new TypedValue(ConstantFP::get(Type::getDoubleTy(getGlobalContext()), 2.5), mkAnonTypeNode(TT_F64));
+
+    addBenchmark(results, "handleImplicitConversion (i32, i64)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++){
+            TypedValue *l = i32, *r = i64;
+            c.handleImplicitConversion(&l, &r);
+            keep(l);
+        }
+    });
+
+    addBenchmark(results, "handleImplicitConversion (i32, f64)", [&](unsigned long n){
+        for(unsigned long i = 0; i < n; i++){
+            TypedValue *l = i32, *r = f64;
+            c.handleImplicitConversion(&l, &r);
+            keep(l);
+        }
+    });
+}
+
+
+void printTable(vector<BenchResult> &results){
+    printf("%-40s %12s %12s %12s %8s %10s\n", "benchmark", "iterations", "median ns", "min ns", "stddev", "MB/s");
+    for(auto &r : results){
+        printf("%-40s %12lu %12.1f %12.1f %7.1f%%", r.name.c_str(), r.iterations,
+                r.medianNs, r.minNs, r.stddevNs / r.meanNs * 100);
+        if(r.bytes) printf(" %10.1f", r.bytes / r.medianNs * 1e3);
+        putchar('\n');
+    }
+}
+
+
+void printJson(vector<BenchResult> &results){
+    puts("{\"benchmarks\": [");
+    for(size_t i = 0; i < results.size(); i++){
+        auto &r = results[i];
+        printf("  {\"name\": \"%s\", \"iterations\": %lu, \"median_ns\": %.2f, \"min_ns\": %.2f, "
+               "\"mean_ns\": %.2f, \"stddev_ns\": %.2f, \"bytes_per_iteration\": %zu}%s\n",
+                r.name.c_str(), r.iterations, r.medianNs, r.minNs, r.meanNs, r.stddevNs, r.bytes,
+                i + 1 < results.size() ? "," : "");
+    }
+    puts("]}");
+}
+
+
+int main(int argc, char *argv[]){
+    bool json = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--json") == 0) json = true;
+        else filter = argv[i];
+    }
+
+    Compiler c{(Node*)nullptr, "microbench"};
+
+    vector<BenchResult> results;
+    benchLexer(results);
+    benchParser(results);
+    benchLookup(results, c);
+    benchTypes(results, c);
+    benchImplicitConversion(results, c);
+
+    if(json) printJson(results);
+    else printTable(results);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+#       bench/runtime.sh
+#   Compares the speed of code generated by ante with that of clang.  Each
+#   kernel in bench/runtime is an ante program along with an equivalent C
+#   program using the same algorithm.  Both are compiled, their outputs are
+#   checked to match, and the best of several runs of each is timed.  The
+#   ratio of ante's time to C's is reported per kernel, followed by the
+#   geometric mean of the ratios.
+#
+#   ante runs a fixed pipeline of function passes (mem2reg, instcombine,
+#   reassociate, GVN, simplifycfg, tail call elimination) followed by
+#   aggressive codegen, which is closest to clang's -O1.  C is compiled with
+#   -fwrapv as ante's integers wrap on overflow.
+#
+#   usage: bench/runtime.sh [path/to/ante]
+#   Run by make bench-runtime.  CC, CFLAGS, and RUNS override the defaults.
+#
+ANTE=$(cd "$(dirname "${1:-./ante}")" && pwd)/$(basename "${1:-./ante}")
+KERNELS=$(cd "$(dirname "$0")/runtime" && pwd)
+CC=${CC:-clang}
+CFLAGS=${CFLAGS:-"-O1 -fwrapv"}
+RUNS=${RUNS:-3}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+
+#input of readlines
+seq 1 1000000 | sed 's/$/ the quick brown fox jumps over the lazy dog/' > lines.txt
+
+# bestMs <program>
+#   Prints the fastest time in ms of RUNS runs of the given program.
+bestMs(){
+    best=""
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        "$1" > /dev/null
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ $ms -lt "$best" ]; then
+            best=$ms
+        fi
+        run=$((run+1))
+    done
+    echo "$best"
+}
+
+printf "%-12s %10s %10s %8s\n" "kernel" "ante (ms)" "C (ms)" "ratio"
+
+ratios=""
+for src in "$KERNELS"/*.an; do
+    name=$(basename "$src" .an)
+    cp "$src" "$name.an"
+    rm -rf .antecache
+
+    if ! "$ANTE" -c "$name.an" > /dev/null || [ ! -x "$name" ]; then
+        printf "%-12s %10s\n" "$name" "failed to compile"
+        continue
+    fi
+    if ! $CC $CFLAGS "$KERNELS/$name.c" -o "$name.c.out"; then
+        printf "%-12s %10s %10s\n" "$name" "" "failed to compile"
+        continue
+    fi
+
+    if [ "$(./"$name")" != "$(./"$name.c.out")" ]; then
+        echo "warning: outputs of $name differ" >&2
+    fi
+
+    anteMs=$(bestMs "./$name")
+    cMs=$(bestMs "./$name.c.out")
+    ratio=$(awk -v a="$anteMs" -v c="$cMs" 'BEGIN { if(c > 0) printf "%.2f", a / c }')
+
+    printf "%-12s %10s %10s %8s\n" "$name" "$anteMs" "$cMs" "$ratio"
+    ratios="$ratios $ratio"
+done
+
+echo "$ratios" | awk '{
+    for(i = 1; i <= NF; i++){ sum += log($i); n++ }
+    if(n) printf "%-12s %10s %10s %8.2f\n", "geomean", "", "", exp(sum / n)
+}'
@@ -0,0 +1,20 @@
+/* C version of bench/runtime/alloc.an */
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(){
+    int i = 0;
+    int acc = 0;
+
+    while(i < 50000000){
+        int *p = malloc(64);
+        p[0] = i;
+        p[15] = i % 1000;
+        acc = (acc + p[0] % 1000 + p[15]) % 1000003;
+        free(p);
+        i += 1;
+    }
+
+    printf("%d\n", acc);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/* C version of bench/runtime/dispatch.an */
+#include <stdio.h>
+
+enum ShapeTag { Circle, Square, Rect };
+
+typedef struct {
+    unsigned char tag;
+    int val;
+} Shape;
+
+Shape mkShape(int i){
+    Shape s;
+    s.val = i;
+    if(i % 3 == 0)
+        s.tag = Circle;
+    else if(i % 3 == 1)
+        s.tag = Square;
+    else
+        s.tag = Rect;
+    return s;
+}
+
+int area(Shape s){
+    int a = 0;
+    switch(s.tag){
+    case Circle: a = s.val * 3 % 1000; break;
+    case Square: a = s.val * s.val % 1000; break;
+    case Rect:   a = s.val * 2 % 1000; break;
+    }
+    return a;
+}
+
+int main(){
+    int i = 0;
+    int acc = 0;
+
+    while(i < 50000000){
+        acc = (acc + area(mkShape(i))) % 1000003;
+        i += 1;
+    }
+
+    printf("%d\n", acc);
+    return 0;
+}
@@ -0,0 +1,12 @@
+/* C version of bench/runtime/fib.an */
+#include <stdio.h>
+
+int fib(int n){
+    if(n <= 2) return 1;
+    return fib(n-2) + fib(n-1);
+}
+
+int main(){
+    printf("%d\n", fib(38));
+    return 0;
+}
@@ -0,0 +1,19 @@
+/* C version of bench/runtime/loops.an */
+#include <stdio.h>
+
+int main(){
+    int acc = 0;
+    int i = 0;
+
+    while(i < 10000){
+        int j = 0;
+        while(j < 10000){
+            acc = (acc + i * j % 7) % 1000003;
+            j += 1;
+        }
+        i += 1;
+    }
+
+    printf("%d\n", acc);
+    return 0;
+}
@@ -0,0 +1,26 @@
+/* C version of bench/runtime/pow.an */
+#include <stdio.h>
+
+int pow_(int base, int exponent){
+    if(exponent == 0){
+        return 1;
+    }else if(exponent % 2 == 0){
+        int v = pow_(base, exponent / 2);
+        return v * v;
+    }else{
+        return base * pow_(base, exponent - 1);
+    }
+}
+
+int main(){
+    int i = 0;
+    int acc = 0;
+
+    while(i < 20000000){
+        acc = (acc + pow_(3, i % 19)) % 1000003;
+        i += 1;
+    }
+
+    printf("%d\n", acc);
+    return 0;
+}
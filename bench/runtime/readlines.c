@@ -0,0 +1,51 @@
+/* C version of bench/runtime/readlines.an, using the same algorithm as the prelude's InFile.nextLine */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef struct {
+    char *cStr;
+    uint32_t len;
+} Str;
+
+Str nextLine(FILE *f){
+    uint32_t len = 0;
+    char *cstr = 0;
+
+    if(feof(f)){
+        Str empty = {"", 0};
+        return empty;
+    }
+
+    while(!feof(f)){
+        char c = fgetc(f);
+        if(len % 32 == 0)
+            cstr = realloc(cstr, len + 32);
+
+        cstr[len] = c;
+        len += 1;
+        if(c == '\n') break;
+    }
+
+    len -= 1;
+    cstr[len] = '\0';
+
+    Str s = {cstr, len};
+    return s;
+}
+
+int main(){
+    FILE *f = fopen("lines.txt", "r");
+    int lines = 0;
+    uint32_t total = 0;
+
+    while(!feof(f)){
+        Str line = nextLine(f);
+        total += line.len;
+        lines += 1;
+        free(line.cStr);
+    }
+
+    printf("%d %u\n", lines, total);
+    return 0;
+}
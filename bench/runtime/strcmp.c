@@ -0,0 +1,44 @@
+/* C version of bench/runtime/strcmp.an, using the same algorithm as the prelude's Str == */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef struct {
+    char *cStr;
+    uint32_t len;
+} Str;
+
+int cStrEq(char *l, char *r){
+    int i = 0;
+    while(l[i] != '\0'){
+        if(l[i] != r[i])
+            return 0;
+        i += 1;
+    }
+    return l[i] == r[i];
+}
+
+int strEq(Str l, Str r){
+    if(l.len != r.len)
+        return 0;
+    return cStrEq(l.cStr, r.cStr);
+}
+
+int main(){
+    Str a = {"the quick brown fox jumps over the lazy dog, again and again", 60};
+    Str b = {"the quick brown fox jumps over the lazy dog, again and again", 60};
+    Str c = {"the quick brown fox jumps over the lazy dog, again and agaim", 60};
+
+    int i = 0;
+    int matches = 0;
+
+    while(i < 10000000){
+        Str s = i % 2 == 0 ? b : c;
+        if(strEq(a, s))
+            matches += 1;
+        i += 1;
+    }
+
+    printf("%d\n", matches);
+    return 0;
+}
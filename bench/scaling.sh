@@ -0,0 +1,183 @@
+#!/bin/sh
+#
+#       bench/scaling.sh
+#   Measures how compile time and memory scale with the size of synthetic
+#   programs: many small functions, deeply nested blocks, long sequences of
+#   statements, wide tagged unions, and long chains of imports.  Each size
+#   is compiled from a clean cache with --time-report and --mem-stats.  The
+#   growth of time and allocations between sizes is shown as a power of the
+#   size, and a step whose time grows faster than SUPERLINEAR_EXPONENT is
+#   flagged as super-linear.
+#
+#   usage: bench/scaling.sh [path/to/ante]
+#   Run by make bench.  SIZES and DEPTHS override the sizes used.
+#
+ANTE=$(cd "$(dirname "${1:-./ante}")" && pwd)/$(basename "${1:-./ante}")
+SIZES=${SIZES:-"250 500 1000 2000 4000"}
+DEPTHS=${DEPTHS:-"25 50 100 200"}
+
+#a step whose time grows by more than its size to this power is flagged
+SUPERLINEAR_EXPONENT=1.5
+
+#steps faster than this, in ms, are too noisy to be flagged
+MIN_FLAGGED_MS=50
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+
+# genFns <n>
+#   n independent functions each called once from main.
+genFns(){
+    i=0
+    while [ $i -lt "$1" ]; do
+        printf "fun f%d: i32 x -> i32\n    x * 2 + %d\n\n" $i $i
+        i=$((i+1))
+    done
+    i=0
+    while [ $i -lt "$1" ]; do
+        printf "print (f%d 1)\n" $i
+        i=$((i+1))
+    done
+}
+
+# genNested <depth>
+#   A single statement nested within depth ifs.
+genNested(){
+    echo "var x = 0"
+    indent=""
+    i=0
+    while [ $i -lt "$1" ]; do
+        echo "${indent}if x < $((i+1)) then"
+        indent="$indent    "
+        i=$((i+1))
+    done
+    echo "${indent}x += 1"
+    echo "print x"
+}
+
+# genStmts <n>
+#   n statements in sequence at the top level.
+genStmts(){
+    echo "var x = 0"
+    i=0
+    while [ $i -lt "$1" ]; do
+        echo "x += $i"
+        i=$((i+1))
+    done
+    echo "print x"
+}
+
+# genUnion <n>
+#   A tagged union of n tags matched on by a single match expression.
+genUnion(){
+    echo "type Wide ="
+    i=0
+    while [ $i -lt "$1" ]; do
+        echo "   | T$i i32"
+        i=$((i+1))
+    done
+    echo
+    echo "fun show: Wide w"
+    echo "    match w with"
+    i=0
+    while [ $i -lt "$1" ]; do
+        echo "    | T$i n -> print (n + $i)"
+        i=$((i+1))
+    done
+    echo
+    echo "show (T$(($1-1)) 1)"
+}
+
+# genImports <n>
+#   A chain of n modules, each importing the one before it.
+genImports(){
+    printf "fun g0: i32 x -> i32\n    x + 1\n" > m0.an
+    i=1
+    while [ $i -lt "$1" ]; do
+        printf "import \"m%d.an\"\n\nfun g%d: i32 x -> i32\n    g%d x + 1\n" $((i-1)) $i $((i-1)) > m$i.an
+        i=$((i+1))
+    done
+    printf "import \"m%d.an\"\n\nprint (g%d 0)\n" $(($1-1)) $(($1-1))
+}
+
+# phaseMs <report> <phase>...
+#   Sums the self time of the given phases in a --time-report.
+phaseMs(){
+    file=$1
+    shift
+    awk -v phases="$(IFS='|'; echo "$*")" '
+        BEGIN { n = split(phases, p, "|") }
+        /%/ {
+            name = $4; for(i = 5; i <= NF; i++) name = name " " $i
+            for(i = 1; i <= n; i++) if(name == p[i]) sum += $1
+        }
+        END { printf "%.1f", sum }' "$file"
+}
+
+# allocKb <report>
+#   Sums the bytes allocated by every category of a --mem-stats report.
+allocKb(){
+    awk '/^Category/ { t = 1; next } t && NF == 0 { t = 0 } t { sum += $NF } END { printf "%d", sum / 1024 }' "$1"
+}
+
+# exponent <n0> <n1> <v0> <v1>
+#   Prints the power of the size by which a value grew between two sizes.
+exponent(){
+    awk -v n0="$1" -v n1="$2" -v v0="$3" -v v1="$4" 'BEGIN {
+        if(v0 > 0 && v1 > 0) printf "%.2f", log(v1 / v0) / log(n1 / n0)
+    }'
+}
+
+# isSuperLinear <exponent> <ms>
+isSuperLinear(){
+    awk -v e="$1" -v ms="$2" -v limit="$SUPERLINEAR_EXPONENT" -v minMs="$MIN_FLAGGED_MS" \
+        'BEGIN { exit !(e != "" && e > limit && ms > minMs) }'
+}
+
+# runWorkload <name> <generator> <sizes>
+runWorkload(){
+    echo "== $1"
+    printf "%8s %10s %10s %10s %10s %10s %10s %10s %8s %8s\n" "size" "total ms" "parse ms" "compile ms" \
+        "opt ms" "codegen ms" "rss KB" "alloc KB" "time" "alloc"
+
+    prevSize=""
+    prevMs=""
+    prevKb=""
+    for n in $3; do
+        rm -rf .antecache m*.an
+        "$2" "$n" > prog.an
+
+        "$ANTE" --time-report --mem-stats -c prog.an > /dev/null 2> report
+        total=$(awk '$NF == "Total" { print $1 }' report)
+        parse=$(phaseMs report Lex Parse)
+        compile=$(phaseMs report Compile "Compile function" Declare Import)
+        opt=$(phaseMs report "Optimize function")
+        codegen=$(phaseMs report Codegen Link)
+        rss=$(awk '/^Peak RSS/ { print $3 }' report)
+        kb=$(allocKb report)
+
+        #growth of time and allocations since the previous size, as n^e
+        timeExp=""
+        kbExp=""
+        flag=""
+        if [ -n "$prevSize" ]; then
+            timeExp=$(exponent "$prevSize" "$n" "$prevMs" "$total")
+            kbExp=$(exponent "$prevSize" "$n" "$prevKb" "$kb")
+            isSuperLinear "$timeExp" "$total" && flag="  SUPER-LINEAR"
+        fi
+
+        printf "%8s %10s %10s %10s %10s %10s %10s %10s %8s %8s%s\n" "$n" "${total:-fail}" "$parse" "$compile" \
+            "$opt" "$codegen" "$rss" "$kb" "${timeExp:+n^$timeExp}" "${kbExp:+n^$kbExp}" "$flag"
+        prevSize=$n
+        prevMs=$total
+        prevKb=$kb
+    done
+    echo
+}
+
+runWorkload "functions" genFns "$SIZES"
+runWorkload "nested blocks" genNested "$DEPTHS"
+runWorkload "statements" genStmts "$SIZES"
+runWorkload "tagged union tags" genUnion "$SIZES"
+runWorkload "import chain" genImports "$DEPTHS"
@@ -0,0 +1,37 @@
+#ifndef AN_CACHE_H
+#define AN_CACHE_H
+
+#include <string>
+#include <vector>
+
+/*
+ *  Directory, relative to the working directory, holding all
+ *  cached compilation results.  Each kind of result is given its
+ *  own subdirectory, and each result is a file named by its key.
+ */
+#define AN_CACHE_DIR ".antecache"
+
+/*
+ *  Bumped whenever the format of a cached result changes so that
+ *  results from older compilers are never reused.
+ */
+#define AN_CACHE_VERSION "1"
+
+namespace ante {
+    void findImports(const std::string &src, std::vector<std::string> &imports);
+
+    namespace cache {
+        std::string hash(const std::string &data);
+
+        bool lookup(const std::string &kind, const std::string &key, std::string &contents);
+        void store(const std::string &kind, const std::string &key, const std::string &contents);
+
+        std::string hashSourceFile(const std::string &fileName, const std::string &flags);
+        bool restoreFile(const std::string &kind, const std::string &key, const std::string &path, bool executable);
+        void storeFile(const std::string &kind, const std::string &key, const std::string &path);
+
+        void printStats();
+    }
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <memory>
 #include <map>
+#include <set>
 #include "parser.h"
 
 using namespace llvm;
@@ -28,6 +29,9 @@ struct TypedValue {
     TypedValue(Value *v, unique_ptr<TypeNode> &ty) : val(v), type(deepCopyTypeNode(ty.get())){}
     
     Type* getType() const{ return val->getType(); }
+
+    static void* operator new(size_t size){ return memstats::allocate(memstats::TypedValues, size); }
+    static void operator delete(void *p){ ::operator delete(p); }
 };
 
 bool isPrimitiveTypeTag(TypeTag ty);
@@ -44,6 +48,42 @@ struct FuncDecl {
     FuncDecl(FuncDeclNode *fn, unsigned int s) : fdn(fn), scope(s){}
 };
 
+/*
+ *  Names of the functions and types used while compiling a single
+ *  function.  Used to determine if its cached IR is still valid.
+ *  A function using a variable declared outside of its outermost
+ *  scope, such as a top-level constant, is not cacheable.
+ */
+struct FnDeps {
+    set<string> fns, types;
+    unsigned int scope = 0;
+    bool cacheable = true;
+};
+
+/*
+ *  Kinds of pointers returned by a single function.  Callers release what
+ *  it returns only if it is reference counted, so they may not be mixed.
+ *  scope is the function's outermost scope, which every return leaves.
+ */
+struct FnReturns {
+    bool refCounted = false, raw = false;
+    unsigned int scope = 0;
+};
+
+/*
+ *  A declaration of an imported module that has not yet been parsed.
+ *  Its source is the given range of lines of the module's file, which
+ *  are parsed when one of the names it declares is first used.
+ */
+struct ImportedDecl {
+    string fileName;
+    unsigned int begin, end;
+    unsigned int scope;
+
+    ImportedDecl(){}
+    ImportedDecl(string f, unsigned int b, unsigned int e, unsigned int s) : fileName(f), begin(b), end(e), scope(s){}
+};
+
 struct MethodVal : public TypedValue {
     TypedValue *obj;
 
@@ -110,12 +150,36 @@ struct Variable {
     }
 
     Variable(string n, TypedValue *tv, unsigned int s, bool nofr=true) : name(n), tval(tv), scope(s), noFree(nofr){}
+
+    static void* operator new(size_t size){ return memstats::allocate(memstats::Variables, size); }
+    static void operator delete(void *p){ ::operator delete(p); }
 };
 
 //forward-declare location for compErr and ante::err
 namespace yy{ class location; }
 
 namespace ante{
+    /*
+     *  Options given on the command line which apply to every
+     *  module compiled by this process.
+     */
+    struct CompilerOptions {
+        //instrument programs to record a profile when run
+        bool profileGenerate;
+
+        //merged profile to optimize programs with, if not empty
+        string profileUse;
+
+        //print how many heap allocations of each module were moved to the stack
+        bool allocReport;
+
+        CompilerOptions() : profileGenerate(false), allocReport(false){}
+    };
+
+    /* Defined in src/pgo.cpp */
+    extern CompilerOptions options;
+    string getProfileFlags();
+
     struct Compiler {
         unique_ptr<ExecutionEngine> jit;
         unique_ptr<legacy::FunctionPassManager> passManager;
@@ -133,19 +197,51 @@ namespace ante{
         //Map of declared usertypes
         map<string, DataType*> userTypes;
 
-        bool errFlag, compiled, isLib;
+        //Map of the names declared by imported modules to their yet unparsed declarations
+        map<string, ImportedDecl> importedDecls;
+
+        //Modules whose interfaces are being read, along with the modules they import
+        set<string> filesBeingImported;
+
+        //Init functions of imported modules to call at the start of main, in the order
+        //they are called.  Only set by the build driver, which links in each module.
+        vector<string> importInits;
+
+        //Dependencies of each function currently being compiled, innermost last
+        vector<FnDeps> fnDeps;
+
+        //Kinds of pointers returned by each function currently being compiled, innermost last
+        vector<FnReturns> fnReturns;
+
+        //Functions marked with ![bench], in the order they were compiled
+        vector<Function*> benchFns;
+
+        bool errFlag, compiled, isLib, isRepl;
+
+        //If true, main runs each ![bench] function as a benchmark after the program's top-level code
+        bool isBenchmark;
+
         string fileName, funcPrefix;
         unsigned int scope;
 
+        //Number of inputs evaluated by the REPL, used to name each input's module
+        unsigned int replLine;
+
+        //Asts of the REPL's previous inputs, kept alive as the variables and
+        //functions they define may still reference their nodes
+        vector<unique_ptr<Node>> replInputs;
+
         Compiler(const char *fileName, bool lib=false);
+        Compiler(Node *root, string modName, bool lib=false);
         ~Compiler();
 
         void compile();
         void compileNative();
         int  compileObj();
         void compilePrelude();
-        void eval();
+        void eval(Node *input);
         void emitIR();
+        void initPassManager();
         void enterNewScope();
         void exitScope();
         void scanAllDecls();
@@ -161,12 +257,47 @@ namespace ante{
         TypedValue* compMemberAccess(Node *ln, VarNode *field, BinOpNode *binop);
         TypedValue* compLogicalOr(Node *l, Node *r, BinOpNode *op);
         TypedValue* compLogicalAnd(Node *l, Node *r, BinOpNode *op);
+
+        //slice functions, defined in src/slice.cpp
+        TypedValue* toSlice(TypedValue *val);
+        TypedValue* compSubSlice(TypedValue *val, BinOpNode *range);
+        TypedValue* compSliceInsert(TypedValue *val, BinOpNode *insertOp, Node *assignExpr);
+        TypedValue* compSliceEq(TypedValue *l, TypedValue *r, BinOpNode *op);
+        TypedValue* compForSlice(ForNode *fn, TypedValue *slice);
+
+        //simd vector functions, defined in src/simd.cpp
+        TypedValue* createVector(TypedValue *val, TypeNode *vecTy);
+        bool matchVectorOperands(TypedValue **l, TypedValue **r, BinOpNode *op);
+        TypedValue* getVectorMethod(string &name);
+
+        //reference counting functions, defined in src/refcount.cpp
+        Function* getRcFunction(const string &name);
+        Value* createRcAlloc(unsigned int size, Type *ptrTy);
+        void createRetain(Value *p);
+        void createRelease(Value *p);
+        void ownTemporary(TypedValue *tval);
+        TypedValue* compBranch(Node *branch, bool keepResult);
+        bool recordReturn(TypedValue *ret, yy::location &loc);
+        void releaseOnReturn(TypedValue *ret);
        
         TypedValue* compErr(string msg, yy::location& loc);
 
         void jitFunction(string& fnName);
         void jitFunction(Function *fnName);
+        void interpretFunction(Function *f);
+        void addModuleToJIT();
+        void execCtFunction(Function *f, bool useJit);
+        void runCtFunction(Function *f, bool useCache, bool useJit=false);
+        TypedValue* registerBenchmark(FuncDeclNode *fdn, TypedValue *fn);
+        void compileBenchHarness();
         void importFile(const char *name);
+        bool loadImportedDecl(string &name);
+        void recordFnDep(string &name);
+        void recordVarDep(Variable *var);
+        bool reuseCachedFn(FuncDeclNode *fdn, TypedValue *fn);
+        void storeCachedFn(FuncDeclNode *fdn, TypedValue *fn, FnDeps deps);
+        string getFnFingerprint(string &bodyKey, FnDeps deps);
+        void addContainedTypes(set<string> &types);
         TypedValue* getFunction(string& name);
         TypedValue* getMangledFunction(string nonMangledName, TypeNode *params);
         
@@ -177,10 +308,13 @@ namespace ante{
         unsigned int getScope() const;
         Variable* lookup(string var) const;
         void stoVar(string var, Variable *val);
-        DataType* lookupType(string tyname) const;
+        DataType* lookupType(string tyname);
         void stoType(DataType *ty, string &typeName);
 
         Type* typeNodeToLlvmType(TypeNode *tyNode);
+        Value* declareInModule(Value *v);
+        Value* createVarStorage(Type *ty, string &name);
+        Value* createEntryBlockStorage(Type *ty, string name);
     
         TypedValue* opImplementedForTypes(int op, TypeNode *l, TypeNode *r);
         TypedValue* implicitlyWidenNum(TypedValue *num, TypeTag castTy);
@@ -189,12 +323,31 @@ namespace ante{
         void implicitlyCastFltToFlt(TypedValue **lhs, TypedValue **rhs);
         void implicitlyCastIntToFlt(TypedValue **tval, Type *ty);
         
+        void runProfilePasses();
+        void releaseAtLastUse();
+        void optimizeRefCounts();
+        void promoteHeapAllocations();
         int compileIRtoObj(string outFile);
 
         static TypedValue* getVoidLiteral();
         static size_t getTupleSize(Node *tup);
         static int linkObj(string inFiles, string outFile);
+        static string getOutputCacheKey(const string &fileName, bool native, bool lib);
+        static bool restoreCachedOutput(const string &fileName, bool native, bool lib=false);
     };
+
+    /* Defined in src/repl.cpp */
+    void startRepl();
+
+    /* Defined in src/build.cpp */
+    int buildProject(const char *rootFile, unsigned int jobs);
+
+    /* Defined in src/server.cpp */
+    int startServer();
+    int runClient(int argc, char *argv[]);
+
+    /* Defined in src/ante.cpp */
+    int runAnte(int argc, char *argv[]);
 }
 
 //conversions
@@ -211,5 +364,28 @@ bool isIntTypeTag(const TypeTag ty);
 bool isFPTypeTag(const TypeTag tt);
 bool isUnsignedTypeTag(const TypeTag tagTy);
 
+/* Defined in src/simd.cpp */
+TypeTag scalarTypeTag(TypeNode *t);
+unsigned int getVectorLanes(TypeNode *vecTy);
+TypeNode* mkCmpTypeNode(TypeNode *t);
+
+/* Defined in src/refcount.cpp */
+bool isRefCounted(const TypeNode *t);
+void markRefCounted(TypeNode *ptrTy);
+TypeNode* mkRefCountedPtrTypeNode(TypeNode *elemTy);
+bool isRcCall(Instruction *inst, const char *name);
+
+/* Defined in src/escape.cpp */
+bool passesReadOnly(CallInst *call, Value *ptr);
+
 string removeFileExt(string file);
+
+/* Defined in src/interface.cpp */
+bool getModuleInterface(const char *fName, string &ani);
+
+/* Defined in src/incremental.cpp */
+string getSourceLines(const string &fileName, unsigned int begin, unsigned int end);
+void forgetSourceLines(const string &fileName);
+
+TargetMachine* getTargetMachine();
 #endif
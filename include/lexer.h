@@ -26,11 +26,15 @@ namespace ante{
     /* General error function */
     void error(const char* msg, yy::location& loc);
 
+    /* Defined in src/lexer.cpp */
+    bool parseVectorTypeName(const string &name, TypeTag *elemTy, unsigned int *lanes);
+
     class Lexer{
     public:
         const char* fileName; 
         
         Lexer(const char *file);
+        Lexer(const char *fName, string &pseudoFile, unsigned int firstRow=1);
         ~Lexer();
         int next(yy::parser::location_type* yyloc);
         char peek() const;
@@ -39,8 +43,8 @@ namespace ante{
         static string getTokStr(int t);
    
     private:
-        /* the ifstream to take from */
-        ifstream *in;
+        /* the istream to take from, either a file, stdin, or a string */
+        istream *in;
 
         /* Row and column number */
         unsigned int row, col;
@@ -0,0 +1,50 @@
+#ifndef AN_MEMSTATS_H
+#define AN_MEMSTATS_H
+
+#include <cstddef>
+#include <new>
+
+namespace ante {
+    struct Compiler;
+
+    namespace memstats {
+        /*
+         *  Kinds of objects whose allocations are counted.  TypeNode copies are
+         *  counted separately from the rest of the ast's nodes.
+         */
+        enum Category {
+            AstNodes,
+            TypeNodeCopies,
+            TypedValues,
+            Variables,
+            NumCategories
+        };
+
+        struct Allocations {
+            unsigned long count, bytes;
+        };
+
+        //total allocations of each category so far, counted whether or not --mem-stats was given
+        extern Allocations allocations[NumCategories];
+
+        /*
+         *  Allocates size bytes for an object of the given category.
+         *  Used as the operator new of each counted type.
+         */
+        inline void* allocate(Category category, size_t size){
+            allocations[category].count++;
+            allocations[category].bytes += size;
+            return ::operator new(size);
+        }
+
+        void reclassify(Category from, Category to, size_t size);
+
+        //true if --mem-stats was given
+        extern bool enabled;
+
+        void enable();
+        void snapshot(const char *phase, Compiler *c);
+    }
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "lexer.h"
 #include "tokens.h"
 #include "location.hh"
+#include "memstats.h"
 
 enum ParseErr{
     PE_OK,
@@ -40,6 +41,9 @@ struct Node{
 
     Node(LOC_TY& l) : next(nullptr), prev(nullptr), loc(l){}
     virtual ~Node(){}
+
+    static void* operator new(size_t size){ return memstats::allocate(memstats::AstNodes, size); }
+    static void operator delete(void *p){ ::operator delete(p); }
 };
 
 /*
@@ -25,6 +25,7 @@ Node* mkArrayNode(LOC_TY loc, Node *expr);
 Node* mkTupleNode(LOC_TY loc, Node *expr);
 Node* mkModNode(LOC_TY loc, TokenType mod);
 Node* mkTypeNode(LOC_TY loc, TypeTag type, char* typeName, Node *extTy = nullptr);
+Node* mkVecTypeNode(LOC_TY loc, char* typeName);
 Node* mkTypeCastNode(LOC_TY loc, Node *l, Node *r);
 Node* mkUnOpNode(LOC_TY loc, int op, Node *r);
 Node* mkBinOpNode(LOC_TY loc, int op, Node* l, Node* r);
@@ -0,0 +1,45 @@
+#ifndef AN_TIMING_H
+#define AN_TIMING_H
+
+#include <string>
+#include <chrono>
+
+namespace ante {
+    namespace timing {
+        typedef std::chrono::steady_clock Clock;
+
+        //true if either --time-report or --time-trace was given
+        extern bool enabled;
+
+        void enableReport();
+        void enableTrace(const std::string &traceFile);
+
+        void beginSpan(const char *phase, const std::string &name);
+        void endSpan();
+        void addLexTime(Clock::time_point start);
+
+        /*
+         *  Times the scope it is declared in as a span of the given phase.
+         *  Spans nest, and a span's name, such as the function it compiles,
+         *  distinguishes it from other spans of the same phase within a trace.
+         *  Does nothing beyond checking timing::enabled unless timing is enabled.
+         */
+        struct Span {
+            bool active;
+
+            Span(const char *phase) : active(enabled){
+                if(active) beginSpan(phase, "");
+            }
+
+            Span(const char *phase, const std::string &name) : active(enabled){
+                if(active) beginSpan(phase, name);
+            }
+
+            ~Span(){
+                if(active) endSpan();
+            }
+        };
+    }
+}
+
+#endif
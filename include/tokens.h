@@ -18,6 +18,8 @@ enum TypeTag{
     TT_StrLit,
     TT_Tuple, //anonymous tuples
     TT_Array,
+    TT_Slice, //pointer and length
+    TT_Vector, //simd vectors, eg. f32x4
     TT_Ptr,
     TT_Data, //all previously declared UserTypes
     TT_TypeVar,
@@ -50,6 +52,7 @@ enum TokenType{
     Tok_C32,
     Tok_Bool,
     Tok_Void,
+    Tok_VecType, //simd vector types, eg. f32x4
 
     /*operators*/
     Tok_Eq,
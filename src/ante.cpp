@@ -3,17 +3,103 @@
 #include "compiler.h"
 #include "ptree.h"
 #include "yyparser.h"
+#include "cache.h"
+#include "timing.h"
 #include <cstring>
 #include <iostream>
+#include <fstream>
+#include <unistd.h>
 using namespace ante;
 
-int main(int argc, char *argv[]){
+/*
+ *  Returns the input files given by the arguments from argv[first] onward.
+ *  An argument of the form @file names a response file listing further
+ *  input files separated by whitespace.
+ */
+vector<string> getInputFiles(int argc, char *argv[], int first){
+    vector<string> files;
+    for(int i = first; i < argc; i++){
+        if(argv[i][0] == '@'){
+            ifstream responseFile{argv[i] + 1};
+            if(!responseFile)
+                cerr << "Error: Unable to open response file '" << argv[i] + 1 << "'\n";
+
+            string file;
+            while(responseFile >> file)
+                files.push_back(file);
+        }else{
+            files.push_back(argv[i]);
+        }
+    }
+    return files;
+}
+
+/*
+ *  Compiles each file in turn within this process.  Each file gets its own
+ *  Compiler, while LLVM's initialization, the TargetMachine, and the interfaces
+ *  of imported modules such as the prelude are shared between them.
+ */
+void compileFiles(vector<string> files, bool native, bool lib=false){
+    for(auto &file : files){
+        if(Compiler::restoreCachedOutput(file, native, lib))
+            continue;
+
+        Compiler ante{file.c_str(), lib};
+        if(native) ante.compileNative();
+        else ante.compileObj();
+    }
+}
+
+/*
+ *  Removes each option that applies to every compiled module, such as
+ *  --profile-generate, --time-report, or --alloc-report, from argv and applies it.
+ *  These may appear anywhere in the arguments.  Returns the new argc.
+ */
+int parseCompilerOptions(int argc, char *argv[]){
+    int newArgc = 1;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--profile-generate") == 0){
+            options.profileGenerate = true;
+        }else if(strncmp(argv[i], "--profile-use=", 14) == 0){
+            options.profileUse = argv[i] + 14;
+        }else if(strcmp(argv[i], "--time-report") == 0){
+            timing::enableReport();
+        }else if(strncmp(argv[i], "--time-trace=", 13) == 0){
+            timing::enableTrace(argv[i] + 13);
+        }else if(strcmp(argv[i], "--mem-stats") == 0){
+            memstats::enable();
+        }else if(strcmp(argv[i], "--alloc-report") == 0){
+            options.allocReport = true;
+        }else{
+            argv[newArgc++] = argv[i];
+        }
+    }
+    return newArgc;
+}
+
+/*
+ *  Runs the command given by argv.  Requests forwarded to a compile
+ *  server are run with this too, within a worker of the server.
+ */
+int ante::runAnte(int argc, char *argv[]){
+    if(argc >= 2 && strcmp(argv[1], "--client") == 0)
+        return runClient(argc - 1, argv + 1);
+
+    argc = parseCompilerOptions(argc, argv);
+    if(options.profileGenerate && !options.profileUse.empty()){
+        cerr << "Ante: --profile-generate and --profile-use cannot be used together\n";
+        return 1;
+    }
+
     if(argc == 2){
         //eval
         if(strcmp(argv[1], "-e") == 0){
-            Compiler ante{0};
-            ante.eval();
-        }else{
+            startRepl();
+        }else if(strcmp(argv[1], "--server") == 0){
+            return startServer();
+        }else if(strcmp(argv[1], "--cache-stats") == 0){
+            cache::printStats();
+        }else if(!Compiler::restoreCachedOutput(argv[1], true)){
             //default = compile
             Compiler ante{argv[1]};
             ante.compileNative();
@@ -49,25 +135,35 @@ int main(int argc, char *argv[]){
             }
         //compile
         }else if(strcmp(argv[1], "-c") == 0){
-            Compiler ante{argv[2]};
-            ante.compileNative();
+            compileFiles(getInputFiles(argc, argv, 2), true);
         }else if(strcmp(argv[1], "-r") == 0){ //compile and run
+            //a cached binary is run without lexing or parsing the file
+            if(!Compiler::restoreCachedOutput(argv[2], true)){
+                Compiler ante{argv[2]};
+                ante.compileNative();
+                if(ante.errFlag) return 1;
+            }
+            system(("./" + removeFileExt(argv[2])).c_str());
+        }else if(strcmp(argv[1], "--bench") == 0){ //build and run the ![bench] functions of a file
             Compiler ante{argv[2]};
+            ante.isBenchmark = true;
             ante.compileNative();
-            if(!ante.errFlag){
-                system(("./" + removeFileExt(ante.fileName)).c_str());
-            }
+            if(ante.errFlag) return 1;
+            return system(("./" + removeFileExt(argv[2]) + "_bench").c_str()) != 0;
+        }else if(strcmp(argv[1], "build") == 0){ //build a program and its imports
+            long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            if(argc >= 5 && strcmp(argv[3], "-j") == 0)
+                jobs = atoi(argv[4]);
+
+            return buildProject(argv[2], jobs > 0 ? jobs : 1);
         }else if(strcmp(argv[1], "-emit-llvm") == 0){
             Compiler ante{argv[2]};
             ante.emitIR();
         }else if(strcmp(argv[1], "-o") == 0){
-            if(strcmp(argv[2], "-lib") == 0){
-                Compiler ante{argv[3], true};
-                ante.compileObj();
-            }else{
-                Compiler ante{argv[2]};
-                ante.compileObj();
-            }
+            if(strcmp(argv[2], "-lib") == 0)
+                compileFiles(getInputFiles(argc, argv, 3), false, true);
+            else
+                compileFiles(getInputFiles(argc, argv, 2), false);
         }else{
             cout << "Ante: argument '" << argv[1] << "' was not recognized.\n";
         }
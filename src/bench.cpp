@@ -0,0 +1,275 @@
+/*
+ *      bench.cpp
+ *  Benchmark harness built by ante --bench.  Each function marked with
+ *  ![bench] gets a loop function calling it a given number of times, and
+ *  main then passes each loop to a shared runner.  The runner doubles the
+ *  number of iterations until a single run of the loop is long enough to
+ *  time accurately, which also warms up the caches, scales the iterations
+ *  to BENCH_SAMPLE_NS per sample, discards one sample, and then times
+ *  BENCH_SAMPLES samples with a monotonic clock before printing their mean,
+ *  median, and standard deviation.
+ *
+ *  The result of each call is stored to a volatile global so that calls to
+ *  pure benchmarks are never optimized away.
+ */
+#include "compiler.h"
+#include <llvm/IR/Intrinsics.h>
+
+#define BENCH_SAMPLES 30
+#define BENCH_SAMPLE_NS 2e7
+#define BENCH_CALIBRATE_NS 1e7
+
+using namespace ante;
+
+
+Constant* getPrintf(Compiler *c){
+    auto &ctxt = getGlobalContext();
+    auto *printfTy = FunctionType::get(Type::getInt32Ty(ctxt), {Type::getInt8PtrTy(ctxt)}, true);
+    return c->module->getOrInsertFunction("printf", printfTy);
+}
+
+
+bool hasBenchDirective(FuncDeclNode *fdn){
+    auto *ppn = dynamic_cast<PreProcNode*>(fdn->modifiers.get());
+    auto *vn = ppn ? dynamic_cast<VarNode*>(ppn->expr.get()) : nullptr;
+    return vn && vn->name == "bench";
+}
+
+
+/*
+ *  Returns a function returning the current time of the monotonic clock in ns.
+ */
+Function* getBenchClock(Compiler *c){
+    if(auto *f = c->module->getFunction("__ante_bench_now"))
+        return f;
+
+    auto &ctxt = getGlobalContext();
+    Type *i64Ty = Type::getInt64Ty(ctxt);
+    Type *tsTy = StructType::get(ctxt, {i64Ty, i64Ty});
+
+    auto *clockTy = FunctionType::get(Type::getInt32Ty(ctxt), {Type::getInt32Ty(ctxt), tsTy->getPointerTo()}, false);
+    Constant *clock_gettime = c->module->getOrInsertFunction("clock_gettime", clockTy);
+
+    auto *f = Function::Create(FunctionType::get(Type::getDoubleTy(ctxt), false), Function::InternalLinkage,
+            "__ante_bench_now", c->module.get());
+    c->builder.SetInsertPoint(BasicBlock::Create(ctxt, "entry", f));
+
+    //1 is CLOCK_MONOTONIC
+    Value *ts = c->builder.CreateAlloca(tsTy);
+    c->builder.CreateCall(clock_gettime, {c->builder.getInt32(1), ts});
+
+    Value *sec = c->builder.CreateLoad(c->builder.CreateStructGEP(tsTy, ts, 0));
+    Value *nsec = c->builder.CreateLoad(c->builder.CreateStructGEP(tsTy, ts, 1));
+    Value *ns = c->builder.CreateAdd(c->builder.CreateMul(sec, c->builder.getInt64(1000000000)), nsec);
+    c->builder.CreateRet(c->builder.CreateSIToFP(ns, Type::getDoubleTy(ctxt)));
+    return f;
+}
+
+
+/*
+ *  Creates a function calling the given benchmark a given number of
+ *  times, returning the time taken in ns.
+ */
+Function* createBenchLoop(Compiler *c, Function *bench){
+    auto &ctxt = getGlobalContext();
+    Type *i64Ty = Type::getInt64Ty(ctxt);
+    Function *now = getBenchClock(c);
+
+    auto *f = Function::Create(FunctionType::get(Type::getDoubleTy(ctxt), {i64Ty}, false),
+            Function::InternalLinkage, "__ante_bench_loop_" + bench->getName().str(), c->module.get());
+    Value *iters = &*f->arg_begin();
+
+    Type *retTy = bench->getReturnType();
+    GlobalVariable *sink = nullptr;
+    if(!retTy->isVoidTy())
+        sink = new GlobalVariable(*c->module, retTy, false, GlobalValue::InternalLinkage,
+                Constant::getNullValue(retTy), "__ante_bench_sink_" + bench->getName().str());
+
+    auto *entry = BasicBlock::Create(ctxt, "entry", f);
+    auto *cond = BasicBlock::Create(ctxt, "cond", f);
+    auto *body = BasicBlock::Create(ctxt, "body", f);
+    auto *done = BasicBlock::Create(ctxt, "done", f);
+
+    c->builder.SetInsertPoint(entry);
+    Value *start = c->builder.CreateCall(now);
+    c->builder.CreateBr(cond);
+
+    c->builder.SetInsertPoint(cond);
+    PHINode *i = c->builder.CreatePHI(i64Ty, 2);
+    i->addIncoming(c->builder.getInt64(0), entry);
+    c->builder.CreateCondBr(c->builder.CreateICmpULT(i, iters), body, done);
+
+    c->builder.SetInsertPoint(body);
+    Value *res = c->builder.CreateCall(bench);
+    if(sink)
+        c->builder.CreateStore(res, sink, true);
+    i->addIncoming(c->builder.CreateAdd(i, c->builder.getInt64(1)), body);
+    c->builder.CreateBr(cond);
+
+    c->builder.SetInsertPoint(done);
+    c->builder.CreateRet(c->builder.CreateFSub(c->builder.CreateCall(now), start));
+    return f;
+}
+
+
+/*
+ *  Returns the comparison function used to sort samples with qsort.
+ */
+Function* getSampleCmp(Compiler *c){
+    auto &ctxt = getGlobalContext();
+    Type *ptrTy = Type::getInt8PtrTy(ctxt);
+    Type *dblPtrTy = Type::getDoublePtrTy(ctxt);
+
+    auto *f = Function::Create(FunctionType::get(Type::getInt32Ty(ctxt), {ptrTy, ptrTy}, false),
+            Function::InternalLinkage, "__ante_bench_cmp", c->module.get());
+    c->builder.SetInsertPoint(BasicBlock::Create(ctxt, "entry", f));
+
+    auto args = f->arg_begin();
+    Value *l = c->builder.CreateLoad(c->builder.CreateBitCast(&*args++, dblPtrTy));
+    Value *r = c->builder.CreateLoad(c->builder.CreateBitCast(&*args, dblPtrTy));
+
+    Value *gt = c->builder.CreateZExt(c->builder.CreateFCmpOGT(l, r), Type::getInt32Ty(ctxt));
+    Value *lt = c->builder.CreateZExt(c->builder.CreateFCmpOLT(l, r), Type::getInt32Ty(ctxt));
+    c->builder.CreateRet(c->builder.CreateSub(gt, lt));
+    return f;
+}
+
+
+/*
+ *  Returns the function which calibrates, times, and prints the results of a
+ *  single benchmark given its name and loop function.
+ */
+Function* getBenchRunner(Compiler *c){
+    if(auto *f = c->module->getFunction("__ante_bench_run"))
+        return f;
+
+    auto &ctxt = getGlobalContext();
+    auto &b = c->builder;
+    Type *i64Ty = Type::getInt64Ty(ctxt);
+    Type *dblTy = Type::getDoubleTy(ctxt);
+    Type *ptrTy = Type::getInt8PtrTy(ctxt);
+    Type *loopTy = FunctionType::get(dblTy, {i64Ty}, false)->getPointerTo();
+    Type *samplesTy = ArrayType::get(dblTy, BENCH_SAMPLES);
+
+    Function *cmp = getSampleCmp(c);
+    auto *qsortTy = FunctionType::get(Type::getVoidTy(ctxt), {ptrTy, i64Ty, i64Ty, cmp->getType()}, false);
+    Constant *qsort = c->module->getOrInsertFunction("qsort", qsortTy);
+    Function *sqrt = Intrinsic::getDeclaration(c->module.get(), Intrinsic::sqrt, {dblTy});
+
+    auto *f = Function::Create(FunctionType::get(Type::getVoidTy(ctxt), {ptrTy, loopTy}, false),
+            Function::InternalLinkage, "__ante_bench_run", c->module.get());
+    auto args = f->arg_begin();
+    Value *name = &*args++;
+    Value *loop = &*args;
+
+    auto *entry = BasicBlock::Create(ctxt, "entry", f);
+    auto *calibrate = BasicBlock::Create(ctxt, "calibrate", f);
+    auto *scale = BasicBlock::Create(ctxt, "scale", f);
+    auto *sample = BasicBlock::Create(ctxt, "sample", f);
+    auto *report = BasicBlock::Create(ctxt, "report", f);
+
+    b.SetInsertPoint(entry);
+    Value *samples = b.CreateAlloca(samplesTy);
+    b.CreateBr(calibrate);
+
+    //double the iterations until a run takes at least BENCH_CALIBRATE_NS
+    b.SetInsertPoint(calibrate);
+    PHINode *iters = b.CreatePHI(i64Ty, 2);
+    iters->addIncoming(b.getInt64(1), entry);
+    Value *t = b.CreateCall(loop, {iters});
+    iters->addIncoming(b.CreateMul(iters, b.getInt64(2)), calibrate);
+    b.CreateCondBr(b.CreateFCmpOLT(t, ConstantFP::get(dblTy, BENCH_CALIBRATE_NS)), calibrate, scale);
+
+    //scale the iterations so each sample takes about BENCH_SAMPLE_NS, then discard one sample
+    b.SetInsertPoint(scale);
+    Value *scaled = b.CreateFMul(b.CreateUIToFP(iters, dblTy), b.CreateFDiv(ConstantFP::get(dblTy, BENCH_SAMPLE_NS), t));
+    Value *sampleIters = b.CreateFPToUI(scaled, i64Ty);
+    sampleIters = b.CreateSelect(b.CreateICmpEQ(sampleIters, b.getInt64(0)), b.getInt64(1), sampleIters);
+    b.CreateCall(loop, {sampleIters});
+    b.CreateBr(sample);
+
+    b.SetInsertPoint(sample);
+    PHINode *k = b.CreatePHI(i64Ty, 2);
+    k->addIncoming(b.getInt64(0), scale);
+    Value *ns = b.CreateFDiv(b.CreateCall(loop, {sampleIters}), b.CreateUIToFP(sampleIters, dblTy));
+    b.CreateStore(ns, b.CreateInBoundsGEP(samplesTy, samples, {b.getInt64(0), k}));
+    Value *nextK = b.CreateAdd(k, b.getInt64(1));
+    k->addIncoming(nextK, sample);
+    b.CreateCondBr(b.CreateICmpULT(nextK, b.getInt64(BENCH_SAMPLES)), sample, report);
+
+    b.SetInsertPoint(report);
+    b.CreateCall(qsort, {b.CreateBitCast(samples, ptrTy), b.getInt64(BENCH_SAMPLES), b.getInt64(8), cmp});
+
+    vector<Value*> s;
+    Value *sum = ConstantFP::get(dblTy, 0);
+    for(unsigned i = 0; i < BENCH_SAMPLES; i++){
+        s.push_back(b.CreateLoad(b.CreateConstInBoundsGEP2_32(samplesTy, samples, 0, i)));
+        sum = b.CreateFAdd(sum, s.back());
+    }
+    Value *mean = b.CreateFDiv(sum, ConstantFP::get(dblTy, BENCH_SAMPLES));
+
+    Value *sqSum = ConstantFP::get(dblTy, 0);
+    for(auto *v : s){
+        Value *d = b.CreateFSub(v, mean);
+        sqSum = b.CreateFAdd(sqSum, b.CreateFMul(d, d));
+    }
+    Value *stddev = b.CreateCall(sqrt, {b.CreateFDiv(sqSum, ConstantFP::get(dblTy, BENCH_SAMPLES))});
+    Value *median = b.CreateFMul(b.CreateFAdd(s[BENCH_SAMPLES/2 - 1], s[BENCH_SAMPLES/2]), ConstantFP::get(dblTy, 0.5));
+
+    Value *fmt = b.CreateGlobalStringPtr("%-32s %14.2f %14.2f %14.2f %12lu\n");
+    b.CreateCall(getPrintf(c), {fmt, name, mean, median, stddev, sampleIters});
+    b.CreateRetVoid();
+    return f;
+}
+
+
+/*
+ *  Registers a function marked with ![bench].  Benchmarks are called
+ *  repeatedly by the harness, so they must take no parameters.
+ */
+TypedValue* Compiler::registerBenchmark(FuncDeclNode *fdn, TypedValue *fn){
+    auto *f = (Function*)fn->val;
+    if(f->arg_size() != 0)
+        return compErr("Benchmark " + fdn->name + " must not take any parameters", fdn->loc);
+
+    benchFns.push_back(f);
+    return fn;
+}
+
+
+/*
+ *  Appends calls to the benchmark runner for each ![bench] function to the end of
+ *  main, after the rest of the program's top-level code has run.
+ */
+void Compiler::compileBenchHarness(){
+    BasicBlock *mainBlock = builder.GetInsertBlock();
+
+    //benchmarks not yet used by the program have not been compiled, which registers them
+    vector<string> uncompiled;
+    for(auto &it : fnDecls)
+        if(it.second && hasBenchDirective(it.second->fdn))
+            uncompiled.push_back(it.first);
+
+    for(auto &name : uncompiled)
+        getFunction(name);
+
+    if(benchFns.empty()){
+        cerr << "Warning: " << fileName << " has no functions marked with ![bench]\n";
+        builder.SetInsertPoint(mainBlock);
+        return;
+    }
+
+    Function *runner = getBenchRunner(this);
+    vector<Function*> loops;
+    for(auto *f : benchFns)
+        loops.push_back(createBenchLoop(this, f));
+
+    builder.SetInsertPoint(mainBlock);
+    builder.CreateCall(getPrintf(this), {builder.CreateGlobalStringPtr("%-32s %14s %14s %14s %12s\n"),
+            builder.CreateGlobalStringPtr("benchmark"), builder.CreateGlobalStringPtr("mean (ns)"),
+            builder.CreateGlobalStringPtr("median (ns)"), builder.CreateGlobalStringPtr("stddev (ns)"),
+            builder.CreateGlobalStringPtr("iterations")});
+
+    for(size_t i = 0; i < benchFns.size(); i++)
+        builder.CreateCall(runner, {builder.CreateGlobalStringPtr(benchFns[i]->getName()), loops[i]});
+}
@@ -0,0 +1,232 @@
+/*
+ *      build.cpp
+ *  Driver for ante build, which compiles a program and every module it
+ *  transitively imports.  The import graph is scanned from the sources
+ *  first, each module is compiled once into its own object, and modules
+ *  whose imports have all been compiled are compiled in parallel, each
+ *  in a separate worker process.  The objects are then linked together.
+ */
+#include "compiler.h"
+#include "cache.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace ante;
+
+
+struct BuildModule {
+    string fileName;
+    vector<size_t> imports, importers;
+
+    //number of this module's imports not yet compiled
+    size_t remainingImports;
+
+    BuildModule(string &f) : fileName(f), remainingImports(0){}
+};
+
+
+struct BuildGraph {
+    vector<BuildModule> modules;
+
+    //each module's index in modules, by the module's canonical path
+    map<string, size_t> indices;
+};
+
+
+/*
+ *  Returns the canonical path of a file so that a module imported through
+ *  different paths is only compiled once.  Returns an empty string if the
+ *  file does not exist.
+ */
+string getCanonicalPath(const string &fileName){
+    char path[PATH_MAX];
+    return realpath(fileName.c_str(), path) ? string(path) : "";
+}
+
+
+/*
+ *  Adds the given module and every module it transitively imports to the
+ *  graph, returning its index.
+ */
+size_t addModule(BuildGraph &graph, string fileName, string &path){
+    auto it = graph.indices.find(path);
+    if(it != graph.indices.end())
+        return it->second;
+
+    size_t idx = graph.modules.size();
+    graph.modules.emplace_back(fileName);
+    graph.indices[path] = idx;
+
+    ifstream f{fileName};
+    stringstream ss;
+    ss << f.rdbuf();
+
+    vector<string> imports;
+    findImports(ss.str(), imports);
+
+    for(auto &import : imports){
+        string importPath = getCanonicalPath(import);
+        if(importPath.empty()) continue;
+
+        size_t importIdx = addModule(graph, import, importPath);
+
+        //modules is reallocated as modules are added, so modules[idx] is not held onto
+        graph.modules[idx].imports.push_back(importIdx);
+        graph.modules[importIdx].importers.push_back(idx);
+    }
+    return idx;
+}
+
+
+enum VisitState { Unvisited, Visiting, Visited };
+
+/*
+ *  Appends each module in the graph to order such that every module comes after
+ *  all of its imports.  Returns false and prints the cycle if there is an import
+ *  cycle.
+ */
+bool sortModules(BuildGraph &graph, size_t idx, vector<VisitState> &state, vector<size_t> &path, vector<size_t> &order){
+    if(state[idx] == Visited) return true;
+
+    path.push_back(idx);
+    if(state[idx] == Visiting){
+        cerr << "Import cycle detected: ";
+        size_t start = 0;
+        while(path[start] != idx) start++;
+
+        for(size_t i = start; i < path.size(); i++)
+            cerr << graph.modules[path[i]].fileName << (i + 1 < path.size() ? " -> " : "\n");
+        return false;
+    }
+
+    state[idx] = Visiting;
+    for(auto import : graph.modules[idx].imports)
+        if(!sortModules(graph, import, state, path, order))
+            return false;
+
+    state[idx] = Visited;
+    path.pop_back();
+    order.push_back(idx);
+    return true;
+}
+
+
+/*
+ *  Compiles a single module into an object within a worker process.  The root
+ *  module is compiled as the program, and calls the init functions of every
+ *  other module in order.  Never returns.
+ */
+void compileModule(BuildModule &mod, bool isRoot, vector<string> &inits){
+    //an imported module's interface is cached before any of its importers are
+    //started, so importers compiled in parallel do not each rebuild it
+    if(!isRoot){
+        string ani;
+        getModuleInterface(mod.fileName.c_str(), ani);
+    }
+
+    if(!isRoot && Compiler::restoreCachedOutput(mod.fileName, false, true))
+        _exit(0);
+
+    Compiler c{mod.fileName.c_str(), !isRoot};
+    if(isRoot)
+        c.importInits = inits;
+
+    int res = c.compileObj();
+    fflush(stdout);
+    _exit(res || c.errFlag);
+}
+
+
+/*
+ *  Compiles rootFile and the modules it imports with up to the given number of
+ *  worker processes, then links them into an executable.  Returns 0 on success.
+ */
+int ante::buildProject(const char *rootFile, unsigned int jobs){
+    BuildGraph graph;
+    string rootPath = getCanonicalPath(rootFile);
+    if(rootPath.empty()){
+        cerr << "Error: Unable to open file '" << rootFile << "'\n";
+        return 1;
+    }
+
+    size_t root = addModule(graph, rootFile, rootPath);
+
+    vector<VisitState> state(graph.modules.size(), Unvisited);
+    vector<size_t> path, order;
+    if(!sortModules(graph, root, state, path, order))
+        return 1;
+
+    //the root's init functions are those of all other modules, imports first
+    vector<string> inits;
+    for(auto idx : order)
+        if(idx != root)
+            inits.push_back("init_" + removeFileExt(graph.modules[idx].fileName));
+
+    vector<size_t> ready;
+    for(size_t i = 0; i < graph.modules.size(); i++){
+        graph.modules[i].remainingImports = graph.modules[i].imports.size();
+        if(graph.modules[i].imports.empty())
+            ready.push_back(i);
+    }
+
+    map<pid_t, size_t> workers;
+    size_t compiled = 0;
+    bool failed = false;
+
+    while(compiled < graph.modules.size() && !(failed && workers.empty())){
+        while(!failed && !ready.empty() && workers.size() < jobs){
+            size_t idx = ready.back();
+            ready.pop_back();
+
+            //flush first so buffered output is not duplicated in the worker
+            fflush(stdout);
+            pid_t pid = fork();
+            if(pid == 0)
+                compileModule(graph.modules[idx], idx == root, inits);
+
+            if(pid < 0){
+                perror("fork");
+                failed = true;
+                break;
+            }
+            workers[pid] = idx;
+        }
+
+        if(workers.empty()) break;
+
+        int status;
+        pid_t pid = wait(&status);
+        if(pid < 0) break;
+
+        auto &mod = graph.modules[workers[pid]];
+        workers.erase(pid);
+
+        if(!WIFEXITED(status) || WEXITSTATUS(status)){
+            cerr << "Failed to compile " << mod.fileName << endl;
+            failed = true;
+            continue;
+        }
+
+        compiled++;
+        for(auto importer : mod.importers)
+            if(--graph.modules[importer].remainingImports == 0)
+                ready.push_back(importer);
+    }
+
+    if(failed || compiled < graph.modules.size())
+        return 1;
+
+    string objFiles;
+    for(auto &mod : graph.modules)
+        objFiles += removeFileExt(mod.fileName) + ".o ";
+
+    int res = Compiler::linkObj(objFiles, removeFileExt(rootFile));
+
+    for(auto &mod : graph.modules)
+        remove((removeFileExt(mod.fileName) + ".o").c_str());
+    return res;
+}
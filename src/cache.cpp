@@ -0,0 +1,290 @@
+/*
+ *      cache.cpp
+ *  On-disk, content-addressed cache of compilation results.
+ *  Results are keyed by a hash of everything that determines
+ *  them so stale entries are simply never looked up again.
+ */
+#include "cache.h"
+#include "target.h"
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/ADT/SmallString.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <set>
+
+using namespace std;
+using namespace llvm;
+
+
+/*
+ *  Returns a string identifying the running compiler.  The executable's size
+ *  and modification time are used rather than its contents, as hashing the
+ *  whole compiler on every run would cost more than most cache hits save.
+ *  It is found once per process, as every key includes it.
+ */
+string getCompilerVersion(){
+    static string version;
+    if(!version.empty())
+        return version;
+
+    string exe = sys::fs::getMainExecutable(nullptr, (void*)&getCompilerVersion);
+
+    struct stat st;
+    version = stat(exe.c_str(), &st) ? exe : exe + " " + to_string(st.st_size) + " " + to_string(st.st_mtime);
+    return version;
+}
+
+
+/*
+ *  Returns the hex string of the md5 hash of data, prefixed with the cache
+ *  version and the running compiler's version, so that results produced by
+ *  a compiler are never reused once it is rebuilt.
+ */
+string ante::cache::hash(const string &data){
+    MD5 md5;
+    md5.update(AN_CACHE_VERSION);
+    md5.update(getCompilerVersion());
+    md5.update(data);
+
+    MD5::MD5Result res;
+    md5.final(res);
+
+    SmallString<32> str;
+    MD5::stringifyResult(res, str);
+    return string(str.begin(), str.end());
+}
+
+
+string getCachePath(const string &kind, const string &key){
+    return string(AN_CACHE_DIR) + "/" + kind + "/" + key;
+}
+
+
+string getStatsPath(){
+    return string(AN_CACHE_DIR) + "/stats";
+}
+
+
+/*
+ *  Hit and miss counts of each kind of result.  The counts of the current
+ *  compilation are added to the totals in .antecache/stats when it exits,
+ *  holding a lock on .antecache/stats.lock so that compilations exiting
+ *  at the same time do not lose each other's counts.
+ */
+struct CacheStats {
+    map<string, pair<unsigned long, unsigned long>> counts;
+
+    void readTotals(map<string, pair<unsigned long, unsigned long>> &totals){
+        ifstream f{getStatsPath()};
+        string kind;
+        unsigned long hits, misses;
+        while(f >> kind >> hits >> misses)
+            totals[kind] = {hits, misses};
+    }
+
+    ~CacheStats(){
+        if(counts.empty() || sys::fs::create_directories(AN_CACHE_DIR))
+            return;
+
+        int lock = open((getStatsPath() + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if(lock < 0) return;
+        flock(lock, LOCK_EX);
+
+        map<string, pair<unsigned long, unsigned long>> totals;
+        readTotals(totals);
+
+        for(auto &it : counts){
+            totals[it.first].first += it.second.first;
+            totals[it.first].second += it.second.second;
+        }
+
+        //replaced rather than rewritten in place so that printStats never sees it partially written
+        string tmpPath = getStatsPath() + "." + to_string(getpid()) + ".tmp";
+        {
+            ofstream f{tmpPath};
+            for(auto &it : totals)
+                f << it.first << ' ' << it.second.first << ' ' << it.second.second << '\n';
+        }
+        sys::fs::rename(tmpPath, getStatsPath());
+
+        flock(lock, LOCK_UN);
+        close(lock);
+    }
+} cacheStats;
+
+
+/*
+ *  Retrieves the contents of a previously stored result.  Returns
+ *  false if there is no result stored for the given key.
+ */
+bool ante::cache::lookup(const string &kind, const string &key, string &contents){
+    ifstream f{getCachePath(kind, key), ios::binary};
+
+    auto &count = cacheStats.counts[kind];
+    if(!f){
+        count.second++;
+        return false;
+    }
+    count.first++;
+
+    stringstream ss;
+    ss << f.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+
+/*
+ *  Stores a result, overwriting any previous result with the same key.
+ *  The result is written to a temporary file first so that an interrupted
+ *  compilation never leaves a partially written entry behind.  Each process
+ *  writes its own temporary file, so compilations storing the same result
+ *  at once, such as the workers of ante build, each rename a complete one.
+ */
+void ante::cache::store(const string &kind, const string &key, const string &contents){
+    if(sys::fs::create_directories(string(AN_CACHE_DIR) + "/" + kind))
+        return;
+
+    string path = getCachePath(kind, key);
+    string tmpPath = path + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream f{tmpPath, ios::binary};
+        if(!f) return;
+        f << contents;
+    }
+    sys::fs::rename(tmpPath, path);
+}
+
+
+/*
+ *  Appends the names of every file imported by the given source, in the
+ *  order they are imported.  Imports are found textually by looking for an
+ *  import keyword followed by a string literal, so no lexing or parsing is
+ *  needed to compute a key or the build's dependency graph.  A spurious
+ *  match, eg. within a comment, only makes a key stricter than it needs to
+ *  be, and is skipped by the build driver if it names no existing file.
+ */
+void ante::findImports(const string &src, vector<string> &imports){
+    size_t pos = 0;
+    while((pos = src.find("import", pos)) != string::npos){
+        bool startsWord = pos == 0 || !(isalnum(src[pos-1]) || src[pos-1] == '_');
+        pos += 6;
+        if(!startsWord) continue;
+
+        size_t strStart = src.find_first_not_of(" \t", pos);
+        if(strStart == string::npos || src[strStart] != '"') continue;
+
+        size_t strEnd = src.find('"', strStart + 1);
+        if(strEnd == string::npos) return;
+
+        imports.push_back(src.substr(strStart + 1, strEnd - strStart - 1));
+        pos = strEnd + 1;
+    }
+}
+
+
+void hashFileAndImports(const string &fileName, MD5 &md5, set<string> &visited){
+    if(!visited.insert(fileName).second)
+        return;
+
+    ifstream f{fileName, ios::binary};
+    stringstream ss;
+    if(f) ss << f.rdbuf();
+    string src = ss.str();
+
+    //the name and length are included so that the boundaries between files
+    //are part of the key, and a missing file hashes differently than an empty one
+    md5.update(fileName);
+    md5.update(f ? to_string(src.length()) : "missing");
+    md5.update(src);
+
+    vector<string> imports;
+    ante::findImports(src, imports);
+    for(auto &import : imports)
+        hashFileAndImports(import, md5, visited);
+}
+
+
+/*
+ *  Returns the key of the result of compiling the given source file with the
+ *  given flags.  The key covers the source, the transitive contents of every
+ *  file it imports including the prelude, the flags, and the compiler itself.
+ */
+string ante::cache::hashSourceFile(const string &fileName, const string &flags){
+    MD5 md5;
+    md5.update(AN_CACHE_VERSION);
+    md5.update(getCompilerVersion());
+    md5.update(flags);
+
+    set<string> visited;
+    hashFileAndImports(fileName, md5, visited);
+    hashFileAndImports(LIB_DIR "/prelude.an", md5, visited);
+
+    MD5::MD5Result res;
+    md5.final(res);
+
+    SmallString<32> str;
+    MD5::stringifyResult(res, str);
+    return string(str.begin(), str.end());
+}
+
+
+/*
+ *  Copies a stored result to the given path.  Returns false if there is no
+ *  result stored for the given key.
+ */
+bool ante::cache::restoreFile(const string &kind, const string &key, const string &path, bool executable){
+    string contents;
+    if(!lookup(kind, key, contents))
+        return false;
+
+    {
+        ofstream f{path, ios::binary | ios::trunc};
+        if(!f) return false;
+        f << contents;
+    }
+
+    if(executable)
+        chmod(path.c_str(), 0755);
+    return true;
+}
+
+
+/*
+ *  Stores the contents of the file at the given path as a result.
+ */
+void ante::cache::storeFile(const string &kind, const string &key, const string &path){
+    ifstream f{path, ios::binary};
+    if(!f) return;
+
+    stringstream ss;
+    ss << f.rdbuf();
+    store(kind, key, ss.str());
+}
+
+
+void ante::cache::printStats(){
+    map<string, pair<unsigned long, unsigned long>> totals;
+    cacheStats.readTotals(totals);
+
+    if(totals.empty()){
+        puts("No cache statistics recorded in " AN_CACHE_DIR "/stats");
+        return;
+    }
+
+    printf("%-8s %10s %10s %8s\n", "kind", "hits", "misses", "hit %");
+    for(auto &it : totals){
+        unsigned long hits = it.second.first;
+        unsigned long total = hits + it.second.second;
+        printf("%-8s %10lu %10lu %7.1f%%\n", it.first.c_str(), hits, it.second.second,
+                total ? 100.0 * hits / total : 0.0);
+    }
+}
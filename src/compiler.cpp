@@ -1,21 +1,28 @@
 #include "parser.h"
 #include "compiler.h"
 #include "target.h"
+#include "cache.h"
+#include "timing.h"
 #include "yyparser.h"
 #include <llvm/IR/Verifier.h>          //for verifying basic structure of functions
 #include <llvm/Bitcode/ReaderWriter.h> //for r/w when outputting bitcode
 #include <llvm/Support/FileSystem.h>   //for r/w when outputting bitcode
 #include <llvm/Support/raw_ostream.h>  //for ostream when outputting bitcode
 #include "llvm/Transforms/Scalar.h"    //for most passes
+#include "llvm/Transforms/IPO.h"       //for the inliner
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/ExecutionEngine/Interpreter.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <unistd.h>
+#include <set>
+#include <sstream>
 
 using namespace llvm;
 
@@ -212,7 +219,7 @@ TypedValue* StrLitNode::compile(Compiler *c){
     auto *ptr = c->builder.CreateGlobalStringPtr(val);
 
     auto* tupleTy = StructType::get(getGlobalContext(), {Type::getInt8PtrTy(getGlobalContext()), Type::getInt32Ty(getGlobalContext())});
-    Constant* strarr[] = {UndefValue::get(Type::getInt8PtrTy(getGlobalContext())), ConstantInt::get(getGlobalContext(), APInt(8, val.length(), true))};
+    Constant* strarr[] = {UndefValue::get(Type::getInt8PtrTy(getGlobalContext())), ConstantInt::get(getGlobalContext(), APInt(32, val.length(), true))};
 
     auto *uninitStr = ConstantStruct::get(tupleTy, strarr);
     auto *str = c->builder.CreateInsertValue(uninitStr, ptr, 0);
@@ -225,21 +232,66 @@ TypedValue* CharLitNode::compile(Compiler *c){
 }
 
 
+/*
+ *  Array literals are stored in the entry block of the function they are
+ *  created in, so their elements may be any expression and creating one
+ *  never allocates on the heap.  The array is given as a pointer to its
+ *  first element, which remains valid until the function returns, so
+ *  returning one or storing it through a pointer is an error.
+ */
 TypedValue* ArrayNode::compile(Compiler *c){
-    vector<Constant*> arr;
-    TypeNode *tyn = mkAnonTypeNode(TT_Array);
+    if(exprs.empty())
+        return c->compErr("The element type of an empty array literal cannot be inferred", loc);
+
+    vector<TypedValue*> elems;
+    elems.reserve(exprs.size());
 
     for(Node *n : exprs){
         auto *tval = n->compile(c);
-        arr.push_back((Constant*)tval->val);
+        if(!tval) return 0;
+        elems.push_back(tval);
+    }
 
-        if(!tyn->extTy.get())
-            tyn->extTy.reset(tval->type.get());
+    TypeNode *elemTy = elems[0]->type.get();
+    for(size_t i = 1; i < elems.size(); i++){
+        if(*elems[i]->type != *elemTy)
+            return c->compErr("Element " + to_string(i+1) + " of the array is a(n) " + typeNodeToStr(elems[i]->type.get()) +
+                    " but the first element is a(n) " + typeNodeToStr(elemTy), exprs[i]->loc);
     }
 
-    auto *ty = ArrayType::get(arr[0]->getType(), exprs.size());
-    auto *val = ConstantArray::get(ty, arr);
-    return new TypedValue(c->builder.CreateConstGEP1_32(val, 0), tyn);
+    auto *ty = ArrayType::get(elems[0]->getType(), elems.size());
+    Value *arr = c->createEntryBlockStorage(ty, "arr");
+
+    //arrays of constants are stored all at once, letting llvm copy them from a constant
+    vector<Constant*> consts;
+    for(auto *e : elems)
+        if(auto *cnst = dynamic_cast<Constant*>(e->val))
+            consts.push_back(cnst);
+
+    if(consts.size() == elems.size()){
+        c->builder.CreateStore(ConstantArray::get(ty, consts), arr);
+    }else{
+        for(size_t i = 0; i < elems.size(); i++)
+            c->builder.CreateStore(elems[i]->val, c->builder.CreateConstInBoundsGEP2_32(ty, arr, 0, i));
+    }
+
+    TypeNode *tyn = mkAnonTypeNode(TT_Array);
+    tyn->extTy.reset(deepCopyTypeNode(elemTy));
+    return new TypedValue(c->builder.CreateConstInBoundsGEP2_32(ty, arr, 0, 0), tyn);
+}
+
+/*
+ *  Returns true if v is the stack storage of an array literal, or a pointer
+ *  into it or a slice of it, which is no longer valid once its function returns.
+ */
+bool isStackArray(Value *v){
+    if(auto *ins = dynamic_cast<InsertValueInst*>(v))
+        return isStackArray(ins->getInsertedValueOperand()) || isStackArray(ins->getAggregateOperand());
+
+    if(auto *gep = dyn_cast<GEPOperator>(v))
+        return isStackArray(gep->getPointerOperand());
+
+    return dynamic_cast<AllocaInst*>(v);
 }
 
 TypedValue* Compiler::getVoidLiteral(){
@@ -320,10 +372,17 @@ vector<TypedValue*> TupleNode::unpack(Compiler *c){
  */
 TypedValue* RetNode::compile(Compiler *c){
     TypedValue *ret = expr->compile(c);
-    if(!ret) return 0;
+    if(!ret || !c->recordReturn(ret, loc)) return 0;
+
+    if(isStackArray(ret->val))
+        return c->compErr("Cannot return an array literal, as its storage is freed when its function returns", loc);
     
     /*Function *f =*/ c->builder.GetInsertBlock()->getParent();
 
+    //the scopes being left release what they own, giving the caller its own
+    //reference to a returned reference counted pointer
+    c->releaseOnReturn(ret);
+
     /*
     if(!llvmTypeEq(ret->getType(), f->getReturnType())){
         return c->compErr("return expression of type " + llvmTypeToStr(ret->getType()) +
@@ -354,7 +413,7 @@ TypedValue* WhileNode::compile(Compiler *c){
     c->builder.CreateCondBr(condval->val, begin, end);
 
     c->builder.SetInsertPoint(begin);
-    auto *val = child->compile(c); //compile the while loop's body
+    auto *val = c->compBranch(child.get(), false); //compile the while loop's body
 
     if(!val) return 0;
     if(!dynamic_cast<ReturnInst*>(val->val))
@@ -365,35 +424,171 @@ TypedValue* WhileNode::compile(Compiler *c){
 }
 
 
-TypedValue* ForNode::compile(Compiler *c){
-    assert(false && "For loops are still unimplemented.");
+/*
+ *  Compiles a for loop over the integers from start up to but excluding end as a
+ *  counted loop.  The range is never created as a value, and the loop variable is
+ *  the loop's single induction variable, kept in a register rather than an alloca.
+ */
+TypedValue* compForRange(Compiler *c, ForNode *fn, BinOpNode *range){
+    TypedValue *start = range->lval->compile(c);
+    TypedValue *end = range->rval->compile(c);
+    if(!start || !end) return 0;
+
+    c->handleImplicitConversion(&start, &end);
+    if(!isIntTypeTag(start->type->type) || !isIntTypeTag(end->type->type))
+        return c->compErr("The bounds of a range must be integers, but are " + typeNodeToStr(start->type.get()) +
+                " and " + typeNodeToStr(end->type.get()), range->loc);
+
+    bool isUnsigned = isUnsignedTypeTag(start->type->type);
 
     Function *f = c->builder.GetInsertBlock()->getParent();
-    BasicBlock *cond  = BasicBlock::Create(getGlobalContext(), "for_cond", f);
-    BasicBlock *begin = BasicBlock::Create(getGlobalContext(), "for", f);
-    BasicBlock *end   = BasicBlock::Create(getGlobalContext(), "end_for", f);
+    BasicBlock *preheader = c->builder.GetInsertBlock();
+    BasicBlock *cond   = BasicBlock::Create(getGlobalContext(), "for_cond", f);
+    BasicBlock *begin  = BasicBlock::Create(getGlobalContext(), "for", f);
+    BasicBlock *latch  = BasicBlock::Create(getGlobalContext(), "for_next", f);
+    BasicBlock *endFor = BasicBlock::Create(getGlobalContext(), "end_for", f);
 
     c->builder.CreateBr(cond);
     c->builder.SetInsertPoint(cond);
-    auto *condval = range->compile(c);
-    c->builder.CreateCondBr(condval->val, begin, end);
+    PHINode *i = c->builder.CreatePHI(start->getType(), 2, fn->var);
+    i->addIncoming(start->val, preheader);
+
+    Value *inRange = isUnsigned ? c->builder.CreateICmpULT(i, end->val) : c->builder.CreateICmpSLT(i, end->val);
+    c->builder.CreateCondBr(inRange, begin, endFor);
 
     c->builder.SetInsertPoint(begin);
-    auto *val = child->compile(c); //compile the while loop's body
+    c->enterNewScope();
+    c->stoVar(fn->var, new Variable(fn->var, new TypedValue(i, start->type), c->scope));
+    auto *val = fn->child->compile(c); //compile the for loop's body
+    c->exitScope();
 
     if(!val) return 0;
     if(!dynamic_cast<ReturnInst*>(val->val))
-        c->builder.CreateBr(cond);
-    
-    c->builder.SetInsertPoint(end);
+        c->builder.CreateBr(latch);
+
+    //i < end, so incrementing i never overflows
+    c->builder.SetInsertPoint(latch);
+    Value *next = c->builder.CreateAdd(i, ConstantInt::get(start->getType(), 1), "", isUnsigned, !isUnsigned);
+    i->addIncoming(next, latch);
+    c->builder.CreateBr(cond);
+
+    c->builder.SetInsertPoint(endFor);
+    return c->getVoidLiteral();
+}
+
+
+/*
+ *  Returns the single-parameter method of the given name in the type of obj,
+ *  or nullptr if there is none.
+ */
+TypedValue* getIterMethod(Compiler *c, TypedValue *obj, string name){
+    string fnName = typeNodeToStr(obj->type.get()) + "_" + name;
+    auto *m = c->getFunction(fnName);
+    if(!m || ((Function*)m->val)->arg_size() != 1 || *obj->type != *(TypeNode*)m->type->extTy->next.get())
+        return nullptr;
+    return m;
+}
+
+
+TypedValue* callIterMethod(Compiler *c, TypedValue *method, Value *obj){
+    return new TypedValue(c->builder.CreateCall(method->val, obj), deepCopyTypeNode(method->type->extTy.get()));
+}
+
+
+/*
+ *  Compiles a for loop over any iterable value.  A value of type T is
+ *  iterable if T.iter: T -> It is defined, or if T itself is an iterator.
+ *  An iterator type It must define
+ *      It.hasNext: It -> bool   true if there is a current element
+ *      It.get: It -> E          the current element, bound to the loop's variable
+ *      It.next: It -> It        the iterator advanced past the current element
+ *
+ *  Iterators are passed and returned by value, and the current one is held in
+ *  a phi rather than in memory, so once the methods are inlined the loop is as
+ *  cheap as one written by hand.
+ */
+TypedValue* compForIter(Compiler *c, ForNode *fn, TypedValue *iterable){
+    TypedValue *it = iterable;
+    if(auto *iter = getIterMethod(c, iterable, "iter"))
+        it = callIterMethod(c, iter, iterable->val);
+
+    auto *hasNext = getIterMethod(c, it, "hasNext");
+    auto *get = getIterMethod(c, it, "get");
+    auto *next = getIterMethod(c, it, "next");
+
+    if(!hasNext || !get || !next)
+        return c->compErr("Type " + typeNodeToStr(iterable->type.get()) + " is not iterable.  It must define iter, or " +
+                typeNodeToStr(it->type.get()) + " must define the methods hasNext, get, and next", fn->range->loc);
+
+    if(hasNext->type->extTy->type != TT_Bool)
+        return c->compErr(typeNodeToStr(it->type.get()) + ".hasNext must return a bool", fn->range->loc);
+
+    if(*next->type->extTy != *it->type)
+        return c->compErr(typeNodeToStr(it->type.get()) + ".next must return a(n) " + typeNodeToStr(it->type.get()) +
+                " but returns a(n) " + typeNodeToStr(next->type->extTy.get()), fn->range->loc);
+
+    Function *f = c->builder.GetInsertBlock()->getParent();
+    BasicBlock *preheader = c->builder.GetInsertBlock();
+    BasicBlock *cond   = BasicBlock::Create(getGlobalContext(), "for_cond", f);
+    BasicBlock *begin  = BasicBlock::Create(getGlobalContext(), "for", f);
+    BasicBlock *latch  = BasicBlock::Create(getGlobalContext(), "for_next", f);
+    BasicBlock *endFor = BasicBlock::Create(getGlobalContext(), "end_for", f);
+
+    c->builder.CreateBr(cond);
+    c->builder.SetInsertPoint(cond);
+    PHINode *cur = c->builder.CreatePHI(it->getType(), 2, "iter");
+    cur->addIncoming(it->val, preheader);
+    c->builder.CreateCondBr(callIterMethod(c, hasNext, cur)->val, begin, endFor);
+
+    c->builder.SetInsertPoint(begin);
+    c->enterNewScope();
+    c->stoVar(fn->var, new Variable(fn->var, callIterMethod(c, get, cur), c->scope));
+    auto *val = fn->child->compile(c); //compile the for loop's body
+    c->exitScope();
+
+    if(!val) return 0;
+    if(!dynamic_cast<ReturnInst*>(val->val))
+        c->builder.CreateBr(latch);
+
+    c->builder.SetInsertPoint(latch);
+    cur->addIncoming(callIterMethod(c, next, cur)->val, latch);
+    c->builder.CreateBr(cond);
+
+    c->builder.SetInsertPoint(endFor);
     return c->getVoidLiteral();
 }
 
+
+TypedValue* ForNode::compile(Compiler *c){
+    auto *bop = dynamic_cast<BinOpNode*>(range.get());
+    if(bop && bop->op == Tok_Range)
+        return compForRange(c, this, bop);
+
+    auto *iterable = range->compile(c);
+    if(!iterable) return 0;
+
+    //slices and array literals are iterated over by index
+    if(iterable->type->type == TT_Slice || iterable->type->type == TT_Array)
+        if(auto *slice = c->toSlice(iterable))
+            return c->compForSlice(this, slice);
+
+    return compForIter(c, this, iterable);
+}
+
 //create a new scope if the user indents
 TypedValue* BlockNode::compile(Compiler *c){
     c->enterNewScope();
     TypedValue *ret = block->compile(c);
+
+    //a reference counted result is kept alive by the enclosing scope
+    bool refCounted = ret && isRefCounted(ret->type.get()) && !dynamic_cast<ReturnInst*>(ret->val);
+    if(refCounted)
+        c->createRetain(ret->val);
+
     c->exitScope();
+
+    if(refCounted)
+        c->ownTemporary(ret);
     return ret;
 }
 
@@ -410,9 +605,17 @@ TypedValue* VarNode::compile(Compiler *c){
     auto *var = c->lookup(name);
 
     if(var){
-        return dynamic_cast<AllocaInst*>(var->getVal()) ?
-            new TypedValue(c->builder.CreateLoad(var->getVal(), name), var->tval->type)
-            : var->tval;
+        if(dynamic_cast<Function*>(var->getVal()))
+            c->recordFnDep(name);
+        else
+            c->recordVarDep(var);
+
+        Value *val = c->declareInModule(var->getVal());
+
+        if(dynamic_cast<AllocaInst*>(val) || dynamic_cast<GlobalVariable*>(val))
+            return new TypedValue(c->builder.CreateLoad(val, name), var->tval->type);
+
+        return val == var->getVal() ? var->tval : new TypedValue(val, var->tval->type);
     }else{
         auto *fn = c->getFunction(name);
 
@@ -433,7 +636,16 @@ TypedValue* LetBindingNode::compile(Compiler *c){
     }
 
     bool nofree = true;//val->type->type != TT_Ptr || dynamic_cast<Constant*>(val->val);
-    c->stoVar(name, new Variable(name, val, c->scope, nofree));
+
+    //the value of a top-level binding in the REPL may be an instruction of an input
+    //that has already finished running, so it must be given its own storage.
+    if(c->isRepl && c->scope == 1 && !dynamic_cast<Function*>(val->val)){
+        auto *global = new TypedValue(c->createVarStorage(val->getType(), name), val->type);
+        c->builder.CreateStore(val->val, global->val);
+        c->stoVar(name, new Variable(name, global, c->scope, nofree));
+    }else{
+        c->stoVar(name, new Variable(name, val, c->scope, nofree));
+    }
     
     return val;
 }
@@ -442,10 +654,15 @@ TypedValue* compVarDeclWithInferredType(VarDeclNode *node, Compiler *c){
     TypedValue *val = node->expr->compile(c);
     if(!val) return nullptr;
         
-    TypedValue *alloca = new TypedValue(c->builder.CreateAlloca(val->getType(), 0, node->name.c_str()), val->type);
-    val = new TypedValue(c->builder.CreateStore(val->val, alloca->val), val->type);
+    TypedValue *alloca = new TypedValue(c->createVarStorage(val->getType(), node->name), val->type);
 
-    bool nofree = true;//val->type->type != TT_Ptr || dynamic_cast<Constant*>(val->val);
+    //a mutable variable holding a reference counted pointer owns its own
+    //reference to it, which it releases when reassigned or when its scope ends
+    bool nofree = !isRefCounted(val->type.get());
+    if(!nofree)
+        c->createRetain(val->val);
+
+    val = new TypedValue(c->builder.CreateStore(val->val, alloca->val), val->type);
     c->stoVar(node->name, new Variable(node->name, alloca, c->scope, nofree));
     return val;
 }
@@ -467,7 +684,7 @@ TypedValue* VarDeclNode::compile(Compiler *c){
     if(!tyNode) return compVarDeclWithInferredType(this, c);
 
     Type *ty = c->typeNodeToLlvmType(tyNode);
-    TypedValue *alloca = new TypedValue(c->builder.CreateAlloca(ty, 0, name.c_str()), tyNode);
+    TypedValue *alloca = new TypedValue(c->createVarStorage(ty, name), tyNode);
 
     Variable *var = new Variable(name, alloca, c->scope);
     c->stoVar(name, var);
@@ -547,6 +764,10 @@ TypedValue* compFieldInsert(Compiler *c, BinOpNode *bop, Node *expr){
                            " to a variable of type " + typeNodeToStr(indexTy), expr->loc);
 
 
+                //the field's copy of a reference counted pointer may outlive its owners
+                if(isRefCounted(newval->type.get()))
+                    c->createRetain(newval->val);
+
                 auto *ins = c->builder.CreateInsertValue(val, newval->val, index);
                 
                 c->builder.CreateStore(ins, var);
@@ -598,6 +819,22 @@ TypedValue* VarAssignNode::compile(Compiler *c){
                     expr->loc);
     }
 
+    //a reference counted variable releases its old value after retaining the
+    //new one, while a copy stored elsewhere may outlive the value's owners
+    if(isRefCounted(tmp->type.get())){
+        if(!isRefCounted(assignExpr->type.get()))
+            return c->compErr("Cannot assign a raw pointer to a reference counted variable", expr->loc);
+
+        c->createRetain(assignExpr->val);
+        c->createRelease(tmp->val);
+    }else if(isRefCounted(assignExpr->type.get())){
+        c->createRetain(assignExpr->val);
+    }
+
+    //variables are freed along with the array literal, but memory behind a pointer may outlive it
+    if(!dynamic_cast<AllocaInst*>(dest) && isStackArray(assignExpr->val))
+        return c->compErr("Cannot store an array literal through a pointer, as its storage is freed when its function returns", expr->loc);
+
     //now actually create the store
     c->builder.CreateStore(assignExpr->val, dest);
 
@@ -629,6 +866,24 @@ vector<Type*> getParamTypes(Compiler *c, NamedValNode *nvn, size_t paramCount){
 }
 
 
+/*
+ *  Returns the linkage of the function defined by fdn.  Functions of an imported
+ *  module are compiled into every module that uses them, so they are given
+ *  linkonce_odr linkage to let the copies be merged when the modules are linked
+ *  together.  Lambdas are only visible within their own module.
+ */
+GlobalValue::LinkageTypes getFnLinkage(Compiler *c, FuncDeclNode *fdn){
+    if(c->isRepl || !fdn->child)
+        return GlobalValue::ExternalLinkage;
+
+    if(fdn->name.empty())
+        return GlobalValue::InternalLinkage;
+
+    bool imported = fdn->loc.begin.filename && *fdn->loc.begin.filename != c->fileName;
+    return imported ? GlobalValue::LinkOnceODRLinkage : GlobalValue::ExternalLinkage;
+}
+
+
 TypedValue* Compiler::compLetBindingFn(FuncDeclNode *fdn, size_t nParams, vector<Type*> &paramTys, unsigned int scope){
     FunctionType *preFnTy = FunctionType::get(Type::getVoidTy(getGlobalContext()), paramTys, fdn->varargs);
 
@@ -646,6 +901,8 @@ TypedValue* Compiler::compLetBindingFn(FuncDeclNode *fdn, size_t nParams, vector
 
     //tell the compiler to create a new scope on the stack.
     enterNewScope();
+    fnReturns.emplace_back();
+    fnReturns.back().scope = scope;
 
     //iterate through each parameter and add its value to the new scope.
     NamedValNode *cParam = fdn->params.get();
@@ -668,6 +925,25 @@ TypedValue* Compiler::compLetBindingFn(FuncDeclNode *fdn, size_t nParams, vector
 
     //actually compile the function, and hold onto the last value
     TypedValue *v = fdn->child->compile(this);
+    if(!v || (!dynamic_cast<ReturnInst*>(v->val) && !recordReturn(v, fdn->loc))){
+        fnReturns.pop_back();
+        return 0;
+    }
+
+    if(v->type->type != TT_Void && isStackArray(v->val)){
+        fnReturns.pop_back();
+        return compErr("Cannot return an array literal, as its storage is freed when its function returns", fdn->loc);
+    }
+
+    //callers own what the function returns if any of its returns are reference counted
+    bool retRefCounted = fnReturns.back().refCounted;
+    fnReturns.pop_back();
+
+    //the caller is given its own reference to a returned reference counted
+    //pointer before the function's references are released
+    if(isRefCounted(v->type.get()) && !dynamic_cast<ReturnInst*>(v->val))
+        createRetain(v->val);
+
     //End of the function, discard the function's scope.
     exitScope();
 
@@ -682,7 +958,7 @@ TypedValue* Compiler::compLetBindingFn(FuncDeclNode *fdn, size_t nParams, vector
 
     //create the actual function's type, along with the function itself.
     FunctionType *ft = FunctionType::get(v->getType(), paramTys, fdn->varargs);
-    Function *f = Function::Create(ft, Function::ExternalLinkage, fdn->name.length() > 0 ? fdn->name : "__lambda__", module.get());
+    Function *f = Function::Create(ft, getFnLinkage(this, fdn), fdn->name.length() > 0 ? fdn->name : "__lambda__", module.get());
    
     //prepend the ret type to the function's type node node extension list.
     //(A typenode represents functions by having the first extTy as the ret type,
@@ -690,6 +966,8 @@ TypedValue* Compiler::compLetBindingFn(FuncDeclNode *fdn, size_t nParams, vector
     curTyn = fnTyn->extTy.get();
     fnTyn->extTy.release();
     TypeNode *retTy = deepCopyTypeNode(v->type.get());
+    if(retRefCounted)
+        markRefCounted(retTy);
     retTy->next.reset(curTyn);
     fnTyn->extTy.reset(retTy);
 
@@ -753,16 +1031,19 @@ TypedValue* compPreProcFn(Compiler *c, FuncDeclNode *fdn, unsigned int scope, Pr
 
     if(VarNode *vn = dynamic_cast<VarNode*>(ppn->expr.get())){
         if(vn->name == "inline"){
-            ((Function*)fn->val)->addFnAttr("always_inline");
-        }else if(vn->name == "ct"){
+            ((Function*)fn->val)->addFnAttr(Attribute::AlwaysInline);
+        }else if(vn->name == "ct" || vn->name == "ct_impure" || vn->name == "ct_jit"){
             auto *mod = c->module.get();
             c->module.release();
 
             c->module.reset(new Module(fdn->name, getGlobalContext()));
             auto *recomp = c->compFn(fdn, scope);
 
-            c->jitFunction((Function*)recomp->val);
+            //impure compile-time functions must be rerun every compilation
+            c->runCtFunction((Function*)recomp->val, vn->name != "ct_impure", vn->name == "ct_jit");
             c->module.reset(mod);
+        }else if(vn->name == "bench"){
+            return c->registerBenchmark(fdn, fn);
         }else{
             return c->compErr("Unrecognized compiler directive", vn->loc);
         }
@@ -774,6 +1055,8 @@ TypedValue* compPreProcFn(Compiler *c, FuncDeclNode *fdn, unsigned int scope, Pr
 }
 
 TypedValue* Compiler::compFn(FuncDeclNode *fdn, unsigned int scope){
+    timing::Span span{"Compile function", fdn->name};
+
     if(PreProcNode *ppn = dynamic_cast<PreProcNode*>(fdn->modifiers.get())){
         return compPreProcFn(this, fdn, scope, ppn);
     }
@@ -803,8 +1086,8 @@ TypedValue* Compiler::compFn(FuncDeclNode *fdn, unsigned int scope){
 
     Type *retTy = typeNodeToLlvmType(retNode);
     FunctionType *ft = FunctionType::get(retTy, paramTys, fdn->varargs);
-    Function *f = Function::Create(ft, Function::ExternalLinkage, fdn->name, module.get());
-    f->addFnAttr("nounwind");
+    Function *f = Function::Create(ft, getFnLinkage(this, fdn), fdn->name, module.get());
+    f->addFnAttr(Attribute::NoUnwind);
    
     auto* ret = new TypedValue(f, fnTy);
     stoVar(fdn->name, new Variable(fdn->name, ret, scope));
@@ -812,6 +1095,13 @@ TypedValue* Compiler::compFn(FuncDeclNode *fdn, unsigned int scope){
     //The above handles everything for a function declaration
     //If the function is a definition, then the body will be compiled here.
     if(fdn->child){
+        //reuse the function's IR from a previous compilation if neither it nor anything it uses has changed
+        if(reuseCachedFn(fdn, ret))
+            return ret;
+
+        fnDeps.emplace_back();
+        fnReturns.emplace_back();
+
         //Create the entry point for the function
         BasicBlock *bb = BasicBlock::Create(getGlobalContext(), "entry", f);
         builder.SetInsertPoint(bb);
@@ -826,6 +1116,8 @@ TypedValue* Compiler::compFn(FuncDeclNode *fdn, unsigned int scope){
 
         //tell the compiler to create a new scope on the stack.
         enterNewScope();
+        fnDeps.back().scope = scope;
+        fnReturns.back().scope = scope;
 
         NamedValNode *cParam = paramsBegin;
 
@@ -838,13 +1130,29 @@ TypedValue* Compiler::compFn(FuncDeclNode *fdn, unsigned int scope){
 
         //actually compile the function, and hold onto the last value
         TypedValue *v = fdn->child->compile(this);
-        if(!v) return 0;
+        if(!v || (!dynamic_cast<ReturnInst*>(v->val) && !recordReturn(v, fdn->loc))){
+            fnDeps.pop_back();
+            fnReturns.pop_back();
+            return 0;
+        }
+
+        //callers own what the function returns if any of its returns are reference counted
+        bool retRefCounted = fnReturns.back().refCounted;
+        fnReturns.pop_back();
+
+        //the caller is given its own reference to a returned reference counted
+        //pointer before the function's references are released
+        if(isRefCounted(v->type.get()) && !dynamic_cast<ReturnInst*>(v->val))
+            createRetain(v->val);
         
         //End of the function, discard the function's scope.
         exitScope();
    
         this->scope = oldScope;
 
+        FnDeps deps = fnDeps.back();
+        fnDeps.pop_back();
+
         //llvm requires explicit returns, so generate a void return even if
         //the user did not in their void function.
         if(retNode && !dynamic_cast<ReturnInst*>(v->val)){
@@ -857,14 +1165,29 @@ TypedValue* Compiler::compFn(FuncDeclNode *fdn, unsigned int scope){
                             typeNodeToStr(retNode), fdn->loc);
                 }
                 
+                if(isStackArray(v->val)){
+                    return compErr("Function " + fdn->name + " cannot return an array literal, as its storage is freed when it returns",
+                            fdn->loc);
+                }
+
                 if(v->type->type == TT_TaggedUnion)
                     fnTy->extTy->type = TT_TaggedUnion;
 
                 builder.CreateRet(v->val);
             }
         }
+
+        //callers own the reference retained for them, including by an explicit return
+        if(retNode && retRefCounted)
+            markRefCounted(fnTy->extTy.get());
         //optimize!
-        passManager->run(*f);
+        {
+            timing::Span optSpan{"Optimize function", fdn->name};
+            passManager->run(*f);
+        }
+
+        if(!errFlag)
+            storeCachedFn(fdn, ret, deps);
     }
 
     return ret;
@@ -1118,7 +1441,7 @@ TypedValue* MatchNode::compile(Compiler *c){
             return c->compErr("Pattern matching non-tagged union types is not yet implemented", mbn->pattern->loc);
         }
 
-        auto *then = mbn->branch->compile(c);
+        auto *then = c->compBranch(mbn->branch.get(), true);
         c->builder.CreateBr(end);
         merges.push_back(pair<BasicBlock*,TypedValue*>(c->builder.GetInsertBlock(), then));
       
@@ -1138,8 +1461,16 @@ TypedValue* MatchNode::compile(Compiler *c){
             if(!dynamic_cast<ReturnInst*>(pair.second->val))
                 phi->addIncoming(pair.second->val, pair.first);
 
-        phi->addIncoming(UndefValue::get(merges[0].second->getType()), matchbb);
-        return new TypedValue(phi, deepCopyTypeNode(merges[0].second->type.get()));
+        //each branch retained its value, so the merged value is owned here instead,
+        //with a null pointer from an unmatched value so that releasing it does nothing
+        auto *ret = new TypedValue(phi, deepCopyTypeNode(merges[0].second->type.get()));
+        bool refCounted = isRefCounted(ret->type.get());
+        Type *phiTy = merges[0].second->getType();
+        phi->addIncoming(refCounted ? Constant::getNullValue(phiTy) : UndefValue::get(phiTy), matchbb);
+
+        if(refCounted)
+            c->ownTemporary(ret);
+        return ret;
     }else{
         return c->getVoidLiteral();
     }
@@ -1151,8 +1482,13 @@ TypedValue* MatchBranchNode::compile(Compiler *c){
 
 
 TypedValue* Compiler::getFunction(string& name){
+    recordFnDep(name);
+
     auto *f = lookup(name);
     if(!f){
+        if(!fnDecls[name] && loadImportedDecl(name))
+            return getFunction(name);
+
         if(auto *pair = fnDecls[name]){
             //Function has been declared but not defined, so define it.
             BasicBlock *caller = builder.GetInsertBlock();
@@ -1161,9 +1497,10 @@ TypedValue* Compiler::getFunction(string& name){
             builder.SetInsertPoint(caller);
             return fn;
         }
-        return 0;
+        return getVectorMethod(name);
     }else{
-        return f->tval;
+        Value *fn = declareInModule(f->getVal());
+        return fn == f->getVal() ? f->tval : new TypedValue(fn, f->tval->type);
     }
 }
     
@@ -1172,36 +1509,6 @@ TypedValue* Compiler::getMangledFunction(string name, TypeNode *params){
     return getFunction(fnName);
 }
 
-/*
- * imports a given ante file to the current module
- * inputted file must exist and be a valid ante source file.
- */
-void Compiler::importFile(const char *fName){
-    Compiler *c = new Compiler(fName, true);
-    c->scanAllDecls();
-
-    if(c->errFlag){
-        cout << "Error when importing " << fName << endl;
-        errFlag = true;
-        delete c;
-        return;
-    }
-
-    //copy import's userTypes into importer
-    for(const auto& it : c->userTypes){
-        userTypes[it.first] = it.second;
-    }
-
-    //copy functions, but change their scope first
-    for(const auto& it : c->fnDecls){
-        it.second->scope = this->scope;
-        fnDecls[it.first] = it.second;
-    }
-
-    delete c;
-}
-
-
 TypeNode* mkAnonTypeNode(TypeTag t){
     auto* empty = new string("");
     
@@ -1246,6 +1553,8 @@ inline void Compiler::registerFunction(FuncDeclNode *fn){
  *  declarations.  Removes compiled functions.
  */
 void Compiler::scanAllDecls(){
+    timing::Span span{"Declare"};
+
     Node *op = ast.get();
     BinOpNode *prev = 0;
     BinOpNode *bop;
@@ -1283,16 +1592,12 @@ void Compiler::scanAllDecls(){
             ast.reset(mkAnonTypeNode(TT_Void)); //TODO: replace this node with one that does not rely on the ::compile function being empty
         }
     }
-}
-
-//evaluates and prints a single-expression module
-//Used in REPL
-void Compiler::eval(){
-    auto *tval = ast->compile(this);
-    tval->val->dump();
+    memstats::snapshot("Declare", this);
 }
 
 void Compiler::compile(){
+    timing::Span span{"Compile", fileName};
+
     //get or create the function type for the main method: void()
     FunctionType *ft = FunctionType::get(Type::getInt8Ty(getGlobalContext()), false);
     
@@ -1303,22 +1608,34 @@ void Compiler::compile(){
     //Create the entry point for the function
     BasicBlock *bb = BasicBlock::Create(getGlobalContext(), "entry", main);
     builder.SetInsertPoint(bb);
+
+    //run the top-level code of each imported module before that of main
+    for(auto &initFn : importInits){
+        Constant *init = module->getOrInsertFunction(initFn, ft);
+        builder.CreateCall(init);
+    }
     
     compilePrelude();
     scanAllDecls();
 
     //Compile the rest of the program
     ast->compile(this);
+
+    if(isBenchmark)
+        compileBenchHarness();
     exitScope();
 
     //builder should already be at end of main function
     builder.CreateRet(ConstantInt::get(getGlobalContext(), APInt(8, 0, true)));
     
-    passManager->run(*main);
-
+    {
+        timing::Span optSpan{"Optimize function", fnName};
+        passManager->run(*main);
+    }
 
     //flag this module as compiled.
     compiled = true;
+    memstats::snapshot("Compile", this);
 
     if(errFlag){
         puts("Compilation aborted.");
@@ -1327,15 +1644,78 @@ void Compiler::compile(){
 }
 
 
+/*
+ *  Returns true if the given file, or any module it transitively imports,
+ *  contains a compile-time function.
+ */
+bool hasCtFunctions(const string &fileName, set<string> &visited){
+    if(!visited.insert(fileName).second)
+        return false;
+
+    ifstream f{fileName};
+    stringstream ss;
+    ss << f.rdbuf();
+    string src = ss.str();
+
+    if(src.find("![ct") != string::npos)
+        return true;
+
+    vector<string> imports;
+    findImports(src, imports);
+    for(auto &import : imports)
+        if(hasCtFunctions(import, visited))
+            return true;
+    return false;
+}
+
+
+/*
+ *  Returns the key of the output of compiling the given file, or an empty string
+ *  if its output should not be cached.  Files containing compile-time functions,
+ *  or importing a module that does, are never cached as those functions may print
+ *  output or have other effects which must happen on every compilation.
+ */
+string Compiler::getOutputCacheKey(const string &fileName, bool native, bool lib){
+    set<string> visited;
+    if(hasCtFunctions(fileName, visited) || hasCtFunctions(LIB_DIR "/prelude.an", visited))
+        return "";
+
+    return cache::hashSourceFile(fileName, string(native ? "native" : "obj") + (lib ? " lib" : "") + getProfileFlags());
+}
+
+
+/*
+ *  Restores the cached output of compiling the given file, if present, without
+ *  lexing or parsing it.  Returns true if the output was restored.
+ */
+bool Compiler::restoreCachedOutput(const string &fileName, bool native, bool lib){
+    string key = getOutputCacheKey(fileName, native, lib);
+    if(key.empty()) return false;
+
+    string modName = removeFileExt(fileName);
+    return native ? cache::restoreFile("bin", key, modName, true)
+                  : cache::restoreFile("obj", key, modName + ".o", false);
+}
+
+
+/*
+ *  Compiles and links the module into an executable, storing the executable in
+ *  the cache.  Callers should try restoreCachedOutput before even constructing
+ *  a Compiler, as a cached executable needs no lexing or parsing either.
+ */
 void Compiler::compileNative(){
     if(!compiled) compile();
 
-    string modName = removeFileExt(fileName);
+    //benchmark harnesses are kept apart from the program's usual executable
+    string modName = removeFileExt(fileName) + (isBenchmark ? "_bench" : "");
     //this file will become the obj file before linking
     string objFile = modName + ".o";
 
     if(!compileIRtoObj(objFile)){
-        linkObj(objFile, modName);
+        if(!linkObj(objFile, modName) && !isBenchmark){
+            string key = getOutputCacheKey(fileName, true, isLib);
+            if(!key.empty()) cache::storeFile("bin", key, modName);
+        }
         remove(objFile.c_str());
     }
 }
@@ -1347,13 +1727,23 @@ int Compiler::compileObj(){
     string modName = removeFileExt(fileName);
     string objFile = modName + ".o";
 
-    return compileIRtoObj(objFile);
+    //objects calling the init functions of their imports are specific to a build
+    int res = compileIRtoObj(objFile);
+    if(!res && importInits.empty()){
+        string key = getOutputCacheKey(fileName, false, isLib);
+        if(!key.empty()) cache::storeFile("obj", key, objFile);
+    }
+    return res;
 }
 
 
 const Target* getTarget(){
-    LLVMInitializeNativeTarget();
-    LLVMInitializeNativeAsmPrinter();
+    static bool initialized = false;
+    if(!initialized){
+        LLVMInitializeNativeTarget();
+        LLVMInitializeNativeAsmPrinter();
+        initialized = true;
+    }
     string err = "";
 
     string triple = Triple(AN_NATIVE_ARCH, AN_NATIVE_VENDOR, AN_NATIVE_OS).getTriple();
@@ -1367,7 +1757,15 @@ const Target* getTarget(){
     return target;
 }
 
+/*
+ *  Returns the TargetMachine of the native target.  It is created once and then
+ *  shared by every Compiler in the process, as creating it costs more than
+ *  emitting the object of a small file.
+ */
 TargetMachine* getTargetMachine(){
+    static unique_ptr<TargetMachine> sharedTm;
+    if(sharedTm) return sharedTm.get();
+
     auto *target = getTarget();
 
     string cpu = "";
@@ -1383,47 +1781,223 @@ TargetMachine* getTargetMachine(){
         exit(1);
     }
     
+    sharedTm.reset(tm);
     return tm;
 }
-void Compiler::jitFunction(Function *f){
+
+/*
+ *  Moves the current module into the JIT, creating the JIT if needed, and
+ *  generates machine code for it.  MCJIT emits code directly into memory,
+ *  so no object file is written.
+ */
+void Compiler::addModuleToJIT(){
     if(!jit.get()){
         LLVMInitializeNativeTarget();
         LLVMInitializeNativeAsmPrinter();
-        auto* eBuilder = new EngineBuilder(unique_ptr<Module>(module.get()));
 
         string err;
+        jit.reset(EngineBuilder(move(module)).setErrorStr(&err).setEngineKind(EngineKind::JIT).create());
 
-        jit.reset(eBuilder->setErrorStr(&err).setEngineKind(EngineKind::JIT).create());
-        if(err.length() > 0) cerr << err << endl;
+        if(!jit.get()){
+            cerr << err << endl;
+            exit(1);
+        }
+    }else{
+        jit->addModule(move(module));
     }
-
-    compileIRtoObj((".tmp_" + f->getName()).str());
-    jit->addModule(move(module));
     jit->finalizeObject();
-    remove((".tmp_" + f->getName()).str().c_str());
-    
+}
+
+void Compiler::jitFunction(Function *f){
+    addModuleToJIT();
     auto* fn = jit->getPointerToFunction(f);
 
     if(fn)
         reinterpret_cast<void(*)()>(fn)();
 }
 
-void Compiler::jitFunction(string& fnName){
-    if(!jit.get()){
-        LLVMInitializeNativeTarget();
-        LLVMInitializeNativeAsmPrinter();
-        auto* eBuilder = new EngineBuilder(unique_ptr<Module>(module.get()));
+/*
+ *  Runs a function of the current module in LLVM's IR interpreter.  This skips
+ *  code generation entirely, so for small functions it has a much lower latency
+ *  than the JIT.  The module is consumed in the process.
+ */
+void Compiler::interpretFunction(Function *f){
+    string err;
+    unique_ptr<ExecutionEngine> interp{EngineBuilder(move(module)).setErrorStr(&err)
+            .setEngineKind(EngineKind::Interpreter).create()};
 
-        string err;
+    if(!interp.get()){
+        cerr << err << endl;
+        exit(1);
+    }
+
+    interp->runFunction(f, vector<GenericValue>());
+}
 
-        jit.reset(eBuilder->setErrorStr(&err).setEngineKind(EngineKind::JIT).create());
-        if(err.length() > 0) cerr << err << endl;
+
+/*
+ *  Modules with more instructions than this are always jitted
+ *  when run at compile-time.
+ */
+#define AN_CT_INTERP_MAX_INSTS 256
+
+/*
+ *  External functions the interpreter can call without being built with libffi.
+ *  See lib/ExecutionEngine/Interpreter/ExternalFunctions.cpp in llvm.
+ */
+const set<string> interpreterExternals = {"printf", "sprintf", "exit", "abort", "memset", "memcpy"};
+
+/*
+ *  Returns true if f may be called again by cur, a function it calls, either
+ *  directly or through the other functions cur calls.  Calls through a pointer
+ *  are assumed to possibly reach f.
+ */
+bool mayCallAgain(Function *f, Function *cur, set<Function*> &visited){
+    for(auto &bb : *cur){
+        for(auto &inst : bb){
+            auto *call = dynamic_cast<CallInst*>(&inst);
+            if(!call) continue;
+
+            Function *callee = call->getCalledFunction();
+            if(!callee || callee == f)
+                return true;
+
+            if(!callee->isDeclaration() && visited.insert(callee).second && mayCallAgain(f, callee, visited))
+                return true;
+        }
     }
+    return false;
+}
 
-    compileIRtoObj(".tmp_" + fnName);
-    jit->addModule(move(module));
-    jit->finalizeObject();
-    remove((".tmp_" + fnName).c_str());
+/*
+ *  Heuristic for choosing between the interpreter and the JIT for a compile-time
+ *  function.  The interpreter is chosen for small modules with no loops or
+ *  recursion, where it finishes long before the JIT would finish generating code.
+ *  Functions that may run for a long time are promoted to the JIT.
+ */
+bool isInterpretable(Module *m){
+    size_t insts = 0;
+
+    for(auto &f : *m){
+        if(f.isDeclaration()){
+            if(!f.isIntrinsic() && !interpreterExternals.count(f.getName().str()))
+                return false;
+            continue;
+        }
+
+        set<BasicBlock*> visited;
+        for(auto &bb : f){
+            visited.insert(&bb);
+            insts += bb.size();
+
+            //a branch back to a previous block is a loop
+            auto *term = bb.getTerminator();
+            for(unsigned i = 0; term && i < term->getNumSuccessors(); i++)
+                if(visited.count(term->getSuccessor(i)))
+                    return false;
+        }
+
+        //recursion, including through other functions, is a loop as well
+        set<Function*> callees;
+        if(mayCallAgain(&f, &f, callees))
+            return false;
+    }
+    return insts <= AN_CT_INTERP_MAX_INSTS;
+}
+
+/*
+ *  Runs a compile-time function with either the interpreter or the JIT.  The JIT is
+ *  used if requested with the ![ct_jit] directive, or if the function appears to be
+ *  long-running.  The ANTE_CT_TIER environment variable may be set to "interp" or
+ *  "jit" to override this choice, which is used when benchmarking the two tiers.
+ */
+void Compiler::execCtFunction(Function *f, bool useJit){
+    const char *tier = getenv("ANTE_CT_TIER");
+
+    if(tier && strcmp(tier, "jit") == 0)
+        useJit = true;
+    else if(tier && strcmp(tier, "interp") == 0)
+        useJit = false;
+    else if(!useJit)
+        useJit = !isInterpretable(module.get());
+
+    if(useJit)
+        jitFunction(f);
+    else
+        interpretFunction(f);
+}
+
+/*
+ *  Runs fn with stdout redirected to a temporary file, and returns
+ *  everything written to stdout during the call.
+ */
+template<typename F>
+string captureStdout(F fn){
+    fflush(stdout);
+    cout.flush();
+    outs().flush();
+
+    FILE *tmp = tmpfile();
+    int oldStdout = dup(STDOUT_FILENO);
+    dup2(fileno(tmp), STDOUT_FILENO);
+
+    fn();
+
+    //llvm's outs() buffers separately from stdio, so both must be flushed to the file
+    fflush(stdout);
+    cout.flush();
+    outs().flush();
+    dup2(oldStdout, STDOUT_FILENO);
+    close(oldStdout);
+
+    string output;
+    rewind(tmp);
+    int c;
+    while((c = fgetc(tmp)) != EOF)
+        output += (char)c;
+
+    fclose(tmp);
+    return output;
+}
+
+/*
+ *  Runs a compile-time function from the current module.  If useCache is set,
+ *  the function's output is saved in the on-disk cache under a hash of the
+ *  module's IR, which includes the function itself and each function it
+ *  transitively calls.  Subsequent compilations with identical IR replay that
+ *  output instead of jitting and running the function again.
+ *
+ *  Compile-time functions currently take no arguments, so their IR is their
+ *  only input.  Functions that depend on anything else (files, time, etc.)
+ *  must be marked with ![ct_impure] to opt out of caching.
+ */
+void Compiler::runCtFunction(Function *f, bool useCache, bool useJit){
+    if(!useCache){
+        execCtFunction(f, useJit);
+        return;
+    }
+
+    string ir;
+    raw_string_ostream os{ir};
+    module->print(os, nullptr);
+    os.flush();
+
+    string key = ante::cache::hash(ir);
+    string output;
+
+    if(!ante::cache::lookup("ct", key, output)){
+        output = captureStdout([&]{ execCtFunction(f, useJit); });
+        ante::cache::store("ct", key, output);
+    }else{
+        //the module would normally be given to the jit, so it must be freed here
+        module.reset();
+    }
+
+    fwrite(output.c_str(), 1, output.length(), stdout);
+}
+
+void Compiler::jitFunction(string& fnName){
+    addModuleToJIT();
     
     auto* fn = jit->getPointerToNamedFunction("testfn");
 
@@ -1436,22 +2010,56 @@ void Compiler::jitFunction(string& fnName){
  *  Invokes llc.
  */
 int Compiler::compileIRtoObj(string outFile){
+    timing::Span span{"Codegen", outFile};
     auto *tm = getTargetMachine();
 
     std::error_code errCode;
     raw_fd_ostream out{outFile, errCode, sys::fs::OpenFlags::F_RW};
 
+    //![inline] functions can only be inlined once every function is compiled,
+    //after which the functions they were inlined into are simplified again.
+    //Allocations that no longer escape once inlined are moved to the stack
+    //in between so that SROA can then split them into registers.  The
+    //function attributes inferred let pointers be passed to functions that
+    //only read them without preventing the promotion of their allocation.
+    legacy::PassManager inliner;
+    inliner.add(createAlwaysInlinerPass());
+    inliner.add(createPostOrderFunctionAttrsPass());
+    inliner.run(*module);
+
+    //reference counts are optimized before the functions maintaining
+    //them are inlined, as calls to them are easier to match
+    releaseAtLastUse();
+    optimizeRefCounts();
+    promoteHeapAllocations();
+
+    legacy::PassManager simplify;
+    simplify.add(createAlwaysInlinerPass());
+    simplify.add(createSROAPass());
+    simplify.add(createInstructionCombiningPass());
+    simplify.add(createGVNPass());
+    simplify.add(createCFGSimplificationPass());
+    simplify.run(*module);
+
+    runProfilePasses();
+
     legacy::PassManager pm;
     int res = tm->addPassesToEmitFile(pm, out, llvm::TargetMachine::CGFT_ObjectFile);
     pm.run(*module);
+    memstats::snapshot("Codegen", this);
 
     return res;
 }
 
 
 int Compiler::linkObj(string inFiles, string outFile){
-    //invoke gcc to link the module.
-    string cmd = "gcc " + inFiles + " -o " + outFile;
+    timing::Span span{"Link", outFile};
+
+    //invoke gcc to link the module.  Instrumented programs are linked with
+    //clang instead, which provides the runtime that writes their profile.
+    string cmd = options.profileGenerate ?
+        "clang -fprofile-instr-generate " + inFiles + " -o " + outFile :
+        "gcc " + inFiles + " -o " + outFile;
     return system(cmd.c_str());
 }
 
@@ -1466,18 +2074,25 @@ void Compiler::emitIR(){
 }
 
 
-inline void Compiler::enterNewScope(){
+void Compiler::enterNewScope(){
     scope++;
     auto *vtable = new map<string, Variable*>();
     varTable.push_back(unique_ptr<map<string, Variable*>>(vtable));
 }
 
 
-inline void Compiler::exitScope(){
+void Compiler::exitScope(){
     //iterate through all known variables, check for pointers at the end of
     //their lifetime, and insert calls to free for any that are found
     auto vtable = varTable.back().get();
 
+    //a scope left by a return had its values released by the return, see releaseOnReturn
+    if(builder.GetInsertBlock() && builder.GetInsertBlock()->getTerminator()){
+        scope--;
+        varTable.pop_back();
+        return;
+    }
+
     for(auto it = vtable->cbegin(); it != vtable->cend(); it++){
         if(it->second->isFreeable() && it->second->scope == this->scope){
             string freeFnName = "free";
@@ -1486,13 +2101,19 @@ inline void Compiler::exitScope(){
             auto *inst = dynamic_cast<AllocaInst*>(it->second->getVal());
             auto *val = inst? builder.CreateLoad(inst) : it->second->getVal();
 
+            bool refCounted = isRefCounted(it->second->tval->type.get());
+
             //change the pointer's type to void so it is not freed again
             it->second->tval->type->type = TT_Void;
 
-            //cast the freed value to i32* as that is what free accepts
-            Type *vPtr = freeFn->getFunctionType()->getFunctionParamType(0);
-            val = builder.CreatePointerCast(val, vPtr);
-            builder.CreateCall(freeFn, val);
+            if(refCounted){
+                createRelease(val);
+            }else{
+                //cast the freed value to i32* as that is what free accepts
+                Type *vPtr = freeFn->getFunctionType()->getFunctionParamType(0);
+                val = builder.CreatePointerCast(val, vPtr);
+                builder.CreateCall(freeFn, val);
+            }
         }
     }
 
@@ -1516,11 +2137,14 @@ void Compiler::stoVar(string var, Variable *val){
 }
 
 
-DataType* Compiler::lookupType(string tyname) const{
+DataType* Compiler::lookupType(string tyname){
+    if(!fnDeps.empty())
+        fnDeps.back().types.insert(tyname);
+
     try{
         return userTypes.at(tyname);
     }catch(out_of_range r){
-        return nullptr;
+        return loadImportedDecl(tyname) ? lookupType(tyname) : nullptr;
     }
 }
 
@@ -1529,14 +2153,64 @@ inline void Compiler::stoType(DataType *ty, string &typeName){
     userTypes[typeName] = ty;
 }
 
+
+/*
+ *  When several modules share the same JIT, as in the REPL, a function or global
+ *  defined in a previously compiled module must be redeclared in the current module
+ *  before it can be used.  Returns v unchanged if it needs no declaration.
+ */
+Value* Compiler::declareInModule(Value *v){
+    if(auto *fn = dynamic_cast<Function*>(v)){
+        if(fn->getParent() != module.get())
+            return module->getOrInsertFunction(fn->getName(), fn->getFunctionType());
+    }else if(auto *global = dynamic_cast<GlobalVariable*>(v)){
+        if(global->getParent() != module.get())
+            return module->getOrInsertGlobal(global->getName(), global->getType()->getElementType());
+    }
+    return v;
+}
+
+
+/*
+ *  Creates the storage for a variable.  Top-level variables in the REPL must
+ *  outlive the function compiled for the input that declared them, so they are
+ *  given global storage.  All other variables are stack allocated.
+ */
+Value* Compiler::createVarStorage(Type *ty, string &name){
+    if(isRepl && scope == 1){
+        string globalName = "__repl" + to_string(replLine) + "_" + name;
+        return new GlobalVariable(*module, ty, false, GlobalValue::ExternalLinkage,
+                Constant::getNullValue(ty), globalName);
+    }
+    return builder.CreateAlloca(ty, 0, name.c_str());
+}
+
+/*
+ *  Allocates storage in the entry block of the current function, so that it is
+ *  allocated once per call even when requested within a loop.  Top-level storage
+ *  in the repl must outlive each input, so it is made global instead.
+ */
+Value* Compiler::createEntryBlockStorage(Type *ty, string name){
+    if(isRepl && scope == 1)
+        return createVarStorage(ty, name);
+
+    BasicBlock &entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+    IRBuilder<> entryBuilder{&entry, entry.begin()};
+    return entryBuilder.CreateAlloca(ty, 0, name);
+}
+
 Compiler::Compiler(const char *_fileName, bool lib) :
         builder(getGlobalContext()), 
         errFlag(false),
         compiled(false),
         isLib(lib),
+        isRepl(false),
+        isBenchmark(false),
         fileName(_fileName? _fileName : "(stdin)"),
-        funcPrefix(""){
+        funcPrefix(""),
+        replLine(0){
 
+    timing::Span parseSpan{"Parse", fileName};
     setLexer(new Lexer(_fileName));
     yy::parser p{};
     int flag = p.parse();
@@ -1557,7 +2231,37 @@ Compiler::Compiler(const char *_fileName, bool lib) :
 
     ast.reset(parser::getRootNode());
     module.reset(new Module(removeFileExt(fileName.c_str()), getGlobalContext()));
+    initPassManager();
+    memstats::snapshot("Parse", this);
+}
+
+/*
+ *  Creates a compiler for an already parsed ast.  Used by the REPL, which
+ *  parses each of its inputs separately.
+ */
+Compiler::Compiler(Node *root, string modName, bool lib) :
+        builder(getGlobalContext()),
+        errFlag(false),
+        compiled(false),
+        isLib(lib),
+        isRepl(false),
+        isBenchmark(false),
+        fileName(modName),
+        funcPrefix(""),
+        replLine(0){
+
+    scope = 0;
+    enterNewScope();
 
+    ast.reset(root);
+    module.reset(new Module(removeFileExt(fileName), getGlobalContext()));
+    initPassManager();
+}
+
+/*
+ *  (Re)creates the function pass manager for the current module.
+ */
+void Compiler::initPassManager(){
     //add passes to passmanager.
     //TODO: change passes based on -O0 through -O3 flags
     passManager.reset(new legacy::FunctionPassManager(module.get()));
@@ -0,0 +1,238 @@
+/*
+ *      escape.cpp
+ *  Escape analysis of heap allocations.  Values created with new are
+ *  malloc'd and then freed when their scope ends, though most never outlive
+ *  the function they are created in.  Once every function is compiled and
+ *  ![inline] functions are inlined, each malloc of a constant size whose
+ *  result does not escape is replaced with an alloca in the entry block of
+ *  its function and the calls freeing it are removed.
+ *
+ *  A pointer escapes if it, or any pointer derived from it by a cast or
+ *  getelementptr, is stored into memory, returned, passed to a function
+ *  other than free, or merged with other values by a phi or select.
+ *  Loading or storing through the pointer and comparing it do not.
+ *
+ *  Allocations initialized with a constant, such as new 5 or new "msg",
+ *  are instead replaced with a private constant global and their frees
+ *  removed if the memory is never written to again and the pointer is
+ *  only loaded from, compared, freed, or passed to a readonly nocapture
+ *  parameter.  A returned or stored pointer is kept on the heap, as
+ *  whoever receives it may write through or free it.
+ */
+#include "compiler.h"
+#include "timing.h"
+
+using namespace ante;
+
+//allocations larger than this are left on the heap to avoid overflowing the stack
+#define MAX_PROMOTED_BYTES 4096
+
+
+/*
+ *  Returns true if ptr escapes.  Otherwise, each call to free on ptr
+ *  or a pointer derived from it is appended to frees.
+ */
+bool escapes(Value *ptr, vector<CallInst*> &frees){
+    for(auto *user : ptr->users()){
+        if(dynamic_cast<LoadInst*>(user) || dynamic_cast<ICmpInst*>(user))
+            continue;
+
+        if(auto *store = dynamic_cast<StoreInst*>(user)){
+            //storing the pointer itself rather than storing through it
+            if(store->getValueOperand() == ptr)
+                return true;
+
+        }else if(dynamic_cast<CastInst*>(user) || dynamic_cast<GetElementPtrInst*>(user)){
+            //pointers cast to integers can be used in ways that cannot be tracked
+            if(!user->getType()->isPointerTy() || escapes(user, frees))
+                return true;
+
+        }else if(auto *call = dynamic_cast<CallInst*>(user)){
+            Function *callee = call->getCalledFunction();
+            if(!callee || callee->getName() != "free")
+                return true;
+            frees.push_back(call);
+
+        }else{
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ *  Returns true if each argument of call that is ptr is neither
+ *  written through nor captured by the called function.
+ */
+bool passesReadOnly(CallInst *call, Value *ptr){
+    for(unsigned int i = 0; i < call->getNumArgOperands(); i++){
+        if(call->getArgOperand(i) != ptr)
+            continue;
+
+        //parameter attributes are indexed from 1
+        bool readOnly = call->paramHasAttr(i + 1, Attribute::ReadOnly)
+                     || call->paramHasAttr(i + 1, Attribute::ReadNone);
+
+        if(!readOnly || !call->paramHasAttr(i + 1, Attribute::NoCapture))
+            return false;
+    }
+    return true;
+}
+
+
+/*
+ *  Returns true if the memory ptr points to is never written to other
+ *  than by the store init and ptr is never returned or stored.
+ *  Otherwise, each call to free on ptr or a pointer derived from it
+ *  is appended to frees.
+ */
+bool isOnlyRead(Value *ptr, StoreInst *init, vector<CallInst*> &frees){
+    for(auto *user : ptr->users()){
+        if(user == init || dynamic_cast<LoadInst*>(user) || dynamic_cast<ICmpInst*>(user))
+            continue;
+
+        if(dynamic_cast<CastInst*>(user) || dynamic_cast<GetElementPtrInst*>(user)){
+            if(!user->getType()->isPointerTy() || !isOnlyRead(user, init, frees))
+                return false;
+
+        }else if(auto *call = dynamic_cast<CallInst*>(user)){
+            Function *callee = call->getCalledFunction();
+            if(callee && callee->getName() == "free")
+                frees.push_back(call);
+            else if(!passesReadOnly(call, ptr))
+                return false;
+
+        }else{
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ *  Returns the store of a constant that initializes the memory returned by
+ *  the given call to malloc, as new does, or nullptr if there is none.
+ */
+StoreInst* getConstantInitializer(CallInst *mallocCall){
+    for(auto it = ++BasicBlock::iterator(mallocCall); it != mallocCall->getParent()->end(); ++it){
+        if(auto *store = dynamic_cast<StoreInst*>(&*it)){
+            if(store->getPointerOperand()->stripPointerCasts() != mallocCall)
+                return nullptr;
+
+            return dynamic_cast<Constant*>(store->getValueOperand()) ? store : nullptr;
+        }
+
+        //the initializer must be stored before anything could read the memory
+        if(it->mayReadOrWriteMemory())
+            return nullptr;
+    }
+    return nullptr;
+}
+
+
+/*
+ *  Returns the constant size in bytes given to a call to malloc, or
+ *  0 if the call is not to malloc or its size is not constant.
+ */
+uint64_t getMallocSize(CallInst *call){
+    Function *callee = call->getCalledFunction();
+    if(!callee || callee->getName() != "malloc" || call->getNumArgOperands() != 1)
+        return 0;
+
+    auto *size = dynamic_cast<ConstantInt*>(call->getArgOperand(0));
+    return size ? size->getZExtValue() : 0;
+}
+
+
+/*
+ *  Replaces the given call to malloc with an alloca of the same
+ *  size in the entry block of its function.
+ */
+void promoteToStack(CallInst *mallocCall, uint64_t size){
+    Function *f = mallocCall->getParent()->getParent();
+    IRBuilder<> entry{&f->getEntryBlock(), f->getEntryBlock().begin()};
+
+    Type *bytesTy = ArrayType::get(Type::getInt8Ty(getGlobalContext()), size);
+    AllocaInst *alloca = entry.CreateAlloca(bytesTy, nullptr, "new");
+
+    //match the alignment malloc guarantees
+    alloca->setAlignment(16);
+
+    Value *ptr = entry.CreatePointerCast(alloca, mallocCall->getType());
+    mallocCall->replaceAllUsesWith(ptr);
+    mallocCall->eraseFromParent();
+}
+
+
+/*
+ *  Replaces the given call to malloc with a private constant global
+ *  holding the value it is initialized with by init.
+ */
+void promoteToStatic(CallInst *mallocCall, StoreInst *init){
+    Module *m = mallocCall->getParent()->getParent()->getParent();
+    auto *initVal = (Constant*)init->getValueOperand();
+
+    auto *global = new GlobalVariable(*m, initVal->getType(), true, GlobalValue::PrivateLinkage, initVal, "new");
+    global->setUnnamedAddr(true);
+
+    init->eraseFromParent();
+    mallocCall->replaceAllUsesWith(ConstantExpr::getPointerCast(global, mallocCall->getType()));
+    mallocCall->eraseFromParent();
+}
+
+
+/*
+ *  Moves each heap allocation of the module that is initialized with a
+ *  constant and only read into static storage, and each other
+ *  non-escaping one onto the stack, printing how many were moved if
+ *  --alloc-report was given.  Must be run after inlining, as passing a
+ *  pointer to a function that has not been inlined causes it to escape.
+ */
+void Compiler::promoteHeapAllocations(){
+    timing::Span span{"Escape analysis", fileName};
+    unsigned int promoted = 0, madeStatic = 0, total = 0;
+
+    for(auto &f : *module){
+        vector<CallInst*> mallocs;
+        for(auto &bb : f)
+            for(auto &inst : bb)
+                if(auto *call = dynamic_cast<CallInst*>(&inst))
+                    if(call->getCalledFunction() && call->getCalledFunction()->getName() == "malloc")
+                        mallocs.push_back(call);
+
+        total += mallocs.size();
+        for(auto *call : mallocs){
+            uint64_t size = getMallocSize(call);
+            if(size == 0)
+                continue;
+
+            vector<CallInst*> frees;
+            StoreInst *init = getConstantInitializer(call);
+
+            if(init && isOnlyRead(call, init, frees)){
+                for(auto *freeCall : frees)
+                    freeCall->eraseFromParent();
+
+                promoteToStatic(call, init);
+                madeStatic++;
+                continue;
+            }
+
+            frees.clear();
+            if(size > MAX_PROMOTED_BYTES || escapes(call, frees))
+                continue;
+
+            for(auto *freeCall : frees)
+                freeCall->eraseFromParent();
+
+            promoteToStack(call, size);
+            promoted++;
+        }
+    }
+
+    if(options.allocReport)
+        fprintf(stderr, "%s: promoted %u of %u heap allocations to the stack and %u to static storage\n",
+                fileName.c_str(), promoted, total, madeStatic);
+}
@@ -0,0 +1,330 @@
+/*
+ *      incremental.cpp
+ *  Function-level incremental compilation.  After a function is compiled
+ *  its IR is stored in the cache along with the names of every function
+ *  and type it used.  On later compilations a function whose source text
+ *  is unchanged, and whose dependencies still have the same signatures
+ *  and definitions, is linked in from the cache instead of recompiled.
+ */
+#include "compiler.h"
+#include "cache.h"
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+#include <fstream>
+#include <sstream>
+
+using namespace ante;
+
+
+/*
+ *  Lines of each source file read so far, so that the source of
+ *  each declaration in a file does not require rereading the file.
+ */
+map<string, vector<string>> sourceLines;
+
+/*
+ *  Returns the given range of lines, inclusive and starting from 1, of a
+ *  source file.  Returns an empty string if the file cannot be read.
+ */
+string getSourceLines(const string &fileName, unsigned int begin, unsigned int end){
+    auto &lines = sourceLines[fileName];
+    if(lines.empty()){
+        ifstream f{fileName};
+        string line;
+        while(getline(f, line))
+            lines.push_back(line);
+    }
+
+    if(begin == 0 || begin > lines.size())
+        return "";
+
+    string text;
+    for(unsigned int i = begin; i <= end && i <= lines.size(); i++)
+        text += lines[i-1] + '\n';
+    return text;
+}
+
+
+/*
+ *  Discards the lines read from the given file, which must be called
+ *  if the file may have changed since it was last read.
+ */
+void forgetSourceLines(const string &fileName){
+    sourceLines.erase(fileName);
+}
+
+
+/*
+ *  Returns the full lines of source spanned by the given location.
+ */
+string getSourceText(yy::location &loc){
+    if(!loc.begin.filename || loc.end.line < loc.begin.line)
+        return "";
+
+    return getSourceLines(*loc.begin.filename, loc.begin.line, loc.end.line);
+}
+
+
+/*
+ *  Returns the key of a function's source, or an empty string
+ *  if the function's source cannot be found.
+ */
+string getFnBodyKey(FuncDeclNode *fdn){
+    string text = getSourceText(fdn->loc);
+    return text.empty() ? "" : cache::hash(fdn->name + '\n' + text);
+}
+
+
+/*
+ *  Adds the name of every usertype in the given type to types.
+ */
+void addTypeNames(TypeNode *tyn, set<string> &types){
+    for(; tyn; tyn = (TypeNode*)tyn->next.get()){
+        if(!tyn->typeName.empty())
+            types.insert(tyn->typeName);
+        addTypeNames(tyn->extTy.get(), types);
+    }
+}
+
+
+/*
+ *  Returns a string describing the full definition of a usertype,
+ *  so that any change to its fields or tags changes its string.
+ */
+string getDataTypeSig(DataType *dt){
+    if(!dt) return "missing";
+
+    string sig = dt->tyn ? typeNodeToStr(dt->tyn.get()) : "void";
+    for(auto &field : dt->fields)
+        sig += ' ' + field;
+
+    for(auto *tag : dt->tags)
+        sig += " | " + tag->name + (tag->tyn ? ' ' + typeNodeToStr(tag->tyn.get()) : "");
+    return sig;
+}
+
+
+/*
+ *  Records that the function being compiled uses the function with the given name.
+ */
+void Compiler::recordFnDep(string &name){
+    if(!fnDeps.empty())
+        fnDeps.back().fns.insert(name);
+}
+
+
+/*
+ *  Records that the function being compiled uses the given variable.  The
+ *  values of variables declared outside of the function are not part of its
+ *  fingerprint, so a function using one is never cached.
+ */
+void Compiler::recordVarDep(Variable *var){
+    if(!fnDeps.empty() && var->scope < fnDeps.back().scope)
+        fnDeps.back().cacheable = false;
+}
+
+
+/*
+ *  Adds each type contained in the given types, transitively, to types,
+ *  as the layout of a type depends on the layouts of the types within it.
+ */
+void Compiler::addContainedTypes(set<string> &types){
+    vector<string> unvisited(types.begin(), types.end());
+    while(!unvisited.empty()){
+        DataType *dt = lookupType(unvisited.back());
+        unvisited.pop_back();
+        if(!dt) continue;
+
+        set<string> contained;
+        addTypeNames(dt->tyn.get(), contained);
+        for(auto *tag : dt->tags)
+            addTypeNames(tag->tyn.get(), contained);
+
+        for(auto &name : contained)
+            if(types.insert(name).second)
+                unvisited.push_back(name);
+    }
+}
+
+
+/*
+ *  Returns the key of a function's cached IR.  The key covers the function's
+ *  source along with the signature of each function and the definition of each
+ *  type it uses, so a change to any of them invalidates it.  As a function
+ *  with an inferred return type has its full type as its signature, changing
+ *  its body only invalidates its callers if its return type changes.
+ *
+ *  Each used function is compiled first if it has not been already, as it would
+ *  be when compiling the function normally.
+ */
+string Compiler::getFnFingerprint(string &bodyKey, FnDeps deps){
+    string data = bodyKey;
+    addContainedTypes(deps.types);
+
+    for(auto name : deps.fns){
+        auto *fn = getFunction(name);
+        data += "\nf " + name + ' ' + (fn ? typeNodeToStr(fn->type.get()) : "missing");
+    }
+
+    for(auto &name : deps.types)
+        data += "\nt " + name + ' ' + getDataTypeSig(lookupType(name));
+
+    return cache::hash(data);
+}
+
+
+/*
+ *  Adds every global value used by v to globals.  Globals used within
+ *  constant expressions, such as a gep of a string literal, are included.
+ */
+void collectGlobals(Value *v, set<GlobalValue*> &globals){
+    if(auto *gv = dynamic_cast<GlobalValue*>(v)){
+        globals.insert(gv);
+    }else if(auto *c = dynamic_cast<Constant*>(v)){
+        for(auto &op : c->operands())
+            collectGlobals(op, globals);
+    }
+}
+
+
+/*
+ *  Copies the given function into a new module of its own.  Functions it calls
+ *  are only declared in the new module, while constant globals it uses, such as
+ *  string literals, are copied along with it.
+ */
+unique_ptr<Module> extractFunction(Function *f){
+    auto *fragment = new Module(f->getName(), getGlobalContext());
+
+    set<GlobalValue*> globals;
+    for(auto &bb : *f)
+        for(auto &inst : bb)
+            for(auto &op : inst.operands())
+                collectGlobals(op, globals);
+
+    Function *newFn = Function::Create(f->getFunctionType(), f->getLinkage(), f->getName(), fragment);
+
+    ValueToValueMapTy vmap;
+    vmap[f] = newFn;
+
+    auto newArg = newFn->arg_begin();
+    for(auto &arg : f->args())
+        vmap[&arg] = &*newArg++;
+
+    for(auto *g : globals){
+        if(g == f) continue;
+
+        if(auto *fn = dynamic_cast<Function*>(g)){
+            vmap[fn] = Function::Create(fn->getFunctionType(), Function::ExternalLinkage, fn->getName(), fragment);
+        }else if(auto *gv = dynamic_cast<GlobalVariable*>(g)){
+            set<GlobalValue*> initGlobals;
+            if(gv->hasInitializer())
+                collectGlobals(gv->getInitializer(), initGlobals);
+
+            bool copy = gv->isConstant() && gv->hasInitializer() && initGlobals.empty();
+
+            vmap[gv] = new GlobalVariable(*fragment, gv->getType()->getElementType(), gv->isConstant(),
+                    copy ? gv->getLinkage() : GlobalValue::ExternalLinkage,
+                    copy ? gv->getInitializer() : nullptr, gv->getName());
+        }
+    }
+
+    SmallVector<ReturnInst*, 4> returns;
+    CloneFunctionInto(newFn, f, vmap, true, returns);
+    return unique_ptr<Module>(fragment);
+}
+
+
+/*
+ *  Stores the IR of a newly compiled function along with the names of the
+ *  functions and types it used, and the changes made to its return type
+ *  once its body was compiled.
+ */
+void Compiler::storeCachedFn(FuncDeclNode *fdn, TypedValue *fn, FnDeps deps){
+    if(isRepl || !deps.cacheable) return;
+
+    string bodyKey = getFnBodyKey(fdn);
+    if(bodyKey.empty()) return;
+
+    //types in the function's signature determine the function's llvm type
+    addTypeNames((TypeNode*)fdn->type.get(), deps.types);
+    for(auto *param = fdn->params.get(); param; param = (NamedValNode*)param->next.get())
+        addTypeNames((TypeNode*)param->typeExpr.get(), deps.types);
+
+    string depList;
+    for(auto &name : deps.fns)
+        depList += "f " + name + '\n';
+    for(auto &name : deps.types)
+        depList += "t " + name + '\n';
+
+    cache::store("fndeps", bodyKey, depList);
+
+    fnDeps.emplace_back();
+    string fingerprint = getFnFingerprint(bodyKey, deps);
+    fnDeps.pop_back();
+
+    string bitcode;
+    raw_string_ostream os{bitcode};
+    WriteBitcodeToFile(extractFunction((Function*)fn->val).get(), os);
+    os.flush();
+
+    //the return type is only known to be a tagged union or reference counted from the body
+    TypeNode *retTy = fn->type->extTy.get();
+    string retFixups;
+    if(retTy->type == TT_TaggedUnion) retFixups += "union\n";
+    if(isRefCounted(retTy)) retFixups += "rc\n";
+
+    cache::store("fnret", fingerprint, retFixups);
+    cache::store("fn", fingerprint, bitcode);
+}
+
+
+/*
+ *  Links the cached IR of a function into the current module if it is still
+ *  valid, in which case fn is updated to the linked function and true is
+ *  returned.  Otherwise the function must be compiled normally.
+ */
+bool Compiler::reuseCachedFn(FuncDeclNode *fdn, TypedValue *fn){
+    if(isRepl) return false;
+
+    string bodyKey = getFnBodyKey(fdn);
+    string depList;
+    if(bodyKey.empty() || !cache::lookup("fndeps", bodyKey, depList))
+        return false;
+
+    FnDeps deps;
+    stringstream ss{depList};
+    string line;
+    while(getline(ss, line)){
+        if(line.length() < 2) continue;
+
+        if(line[0] == 'f') deps.fns.insert(line.substr(2));
+        else deps.types.insert(line.substr(2));
+    }
+
+    fnDeps.emplace_back();
+    string fingerprint = getFnFingerprint(bodyKey, deps);
+    fnDeps.pop_back();
+
+    string bitcode, retFixups;
+    if(!cache::lookup("fnret", fingerprint, retFixups) || !cache::lookup("fn", fingerprint, bitcode))
+        return false;
+
+    auto fragment = parseBitcodeFile(MemoryBufferRef(bitcode, fdn->name), getGlobalContext());
+    if(!fragment || Linker::linkModules(*module, move(fragment.get())))
+        return false;
+
+    //linking replaces the function's declaration with the cached definition
+    fn->val = module->getFunction(fdn->name);
+
+    //redo the changes compiling the body would have made to the return type
+    TypeNode *retTy = fn->type->extTy.get();
+    if(retFixups.find("union\n") != string::npos)
+        retTy->type = TT_TaggedUnion;
+    if(retFixups.find("rc\n") != string::npos)
+        markRefCounted(retTy);
+    return true;
+}
@@ -0,0 +1,265 @@
+/*
+ *      interface.cpp
+ *  Module interfaces, which let imports be loaded lazily.  The interface
+ *  of a module lists each name it declares along with the range of lines
+ *  of the declaration defining it.  Importing a module only reads its
+ *  interface, and each declaration is parsed the first time one of its
+ *  names is used, so an import costs only as much as what is used from it.
+ *
+ *  Interfaces are stored in .antecache/ani, keyed by the contents of their
+ *  module, so they are rebuilt only when the module changes.  Each is a
+ *  header line followed by one "import <file>" line per module the module
+ *  imports, then one "<begin> <end> <name>" line per name.  The modules a
+ *  module imports are imported along with it, as its declarations may use
+ *  their names once they are parsed in the importer.
+ */
+#include "compiler.h"
+#include "cache.h"
+#include "timing.h"
+#include "yyparser.h"
+#include <sys/stat.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+/*
+ *  First line of every module interface.  The version is bumped
+ *  whenever the format of module interfaces changes.
+ */
+#define AN_INTERFACE_HEADER "ani 2"
+
+using namespace ante;
+
+
+bool isTopLevelDecl(Node *n){
+    return dynamic_cast<FuncDeclNode*>(n) || dynamic_cast<ExtNode*>(n) || dynamic_cast<DataDeclNode*>(n);
+}
+
+
+/*
+ *  Adds each name in after that was not in before, or that now refers to
+ *  something else, to names.
+ */
+template<typename T>
+void addNewNames(map<string, T*> &before, map<string, T*> &after, vector<string> &names){
+    for(auto &it : after){
+        auto prev = before.find(it.first);
+        if(it.second && (prev == before.end() || prev->second != it.second))
+            names.push_back(it.first);
+    }
+}
+
+
+struct InterfaceDecl {
+    unsigned int begin, end;
+    vector<string> names;
+};
+
+
+/*
+ *  Builds the interface of a module by parsing it in full and registering each
+ *  of its top-level declarations in turn to find the names each one declares.
+ *  Returns false if the module failed to compile.
+ */
+bool buildModuleInterface(const char *fName, string &ani){
+    Compiler c{fName, true};
+
+    //the ast is a left-leaning tree of statements, so its declarations are found last to first
+    vector<Node*> declNodes, importNodes;
+    Node *op = c.ast.get();
+    BinOpNode *bop;
+    while((bop = dynamic_cast<BinOpNode*>(op)) && bop->op == ';'){
+        if(isTopLevelDecl(bop->rval.get()))
+            declNodes.push_back(bop->rval.get());
+        else if(dynamic_cast<ImportNode*>(bop->rval.get()))
+            importNodes.push_back(bop->rval.get());
+        op = bop->lval.get();
+    }
+    if(isTopLevelDecl(op))
+        declNodes.push_back(op);
+    else if(dynamic_cast<ImportNode*>(op))
+        importNodes.push_back(op);
+
+    reverse(declNodes.begin(), declNodes.end());
+    reverse(importNodes.begin(), importNodes.end());
+
+    vector<InterfaceDecl> decls;
+    for(auto *n : declNodes){
+        auto fnDecls = c.fnDecls;
+        auto userTypes = c.userTypes;
+
+        n->compile(&c);
+
+        InterfaceDecl decl;
+        decl.begin = n->loc.begin.line;
+        decl.end = max(n->loc.end.line, n->loc.begin.line);
+        addNewNames(fnDecls, c.fnDecls, decl.names);
+        addNewNames(userTypes, c.userTypes, decl.names);
+        decls.push_back(decl);
+    }
+
+    if(c.errFlag) return false;
+
+    ani = AN_INTERFACE_HEADER "\n";
+    for(auto *n : importNodes)
+        if(auto *path = dynamic_cast<StrLitNode*>(((ImportNode*)n)->expr.get()))
+            ani += "import " + path->val + '\n';
+
+    for(size_t i = 0; i < decls.size(); i++){
+        //the unindent ending a declaration is located on the line after it, which
+        //may be the first line of the next declaration
+        if(i + 1 < decls.size() && decls[i].end >= decls[i+1].begin)
+            decls[i].end = max(decls[i].begin, decls[i+1].begin - 1);
+
+        for(auto &name : decls[i].names)
+            ani += to_string(decls[i].begin) + ' ' + to_string(decls[i].end) + ' ' + name + '\n';
+    }
+    return true;
+}
+
+
+/*
+ *  Reads the interface of a module from the cache, building it if the module
+ *  has changed since its interface was last built.  Returns false if the module
+ *  failed to compile.
+ */
+bool readModuleInterface(const char *fName, string &ani){
+    ifstream f{fName};
+    stringstream ss;
+    ss << f.rdbuf();
+
+    string key = cache::hash(string(fName) + '\n' + ss.str());
+    if(cache::lookup("ani", key, ani) && ani.compare(0, strlen(AN_INTERFACE_HEADER "\n"), AN_INTERFACE_HEADER "\n") == 0)
+        return true;
+
+    if(!buildModuleInterface(fName, ani))
+        return false;
+
+    cache::store("ani", key, ani);
+    return true;
+}
+
+
+/*
+ *  Retrieves the interface of a module.  Returns false if the module
+ *  failed to compile.
+ */
+bool getModuleInterface(const char *fName, string &ani){
+    //modules imported by several files compiled in one process, such as the
+    //prelude, only have their interface read once while they are unchanged
+    static map<string, pair<string, string>> loadedInterfaces;
+
+    struct stat st;
+    string version = stat(fName, &st) ? "" : to_string(st.st_size) + " " + to_string(st.st_mtime);
+
+    auto loaded = loadedInterfaces.find(fName);
+    if(loaded != loadedInterfaces.end() && !version.empty() && loaded->second.first == version){
+        ani = loaded->second.second;
+        return true;
+    }
+
+    //the module's lines may have been read before it changed
+    if(loaded != loadedInterfaces.end())
+        forgetSourceLines(fName);
+
+    if(!readModuleInterface(fName, ani))
+        return false;
+
+    loadedInterfaces[fName] = {version, ani};
+    return true;
+}
+
+
+/*
+ * imports a given ante file to the current module
+ * inputted file must exist and be a valid ante source file.
+ */
+void Compiler::importFile(const char *fName){
+    //modules in an import cycle are already being imported further up
+    if(!filesBeingImported.insert(fName).second)
+        return;
+
+    timing::Span span{"Import", fName};
+
+    string ani;
+    if(!getModuleInterface(fName, ani)){
+        cout << "Error when importing " << fName << endl;
+        errFlag = true;
+        filesBeingImported.erase(fName);
+        return;
+    }
+
+    stringstream ss{ani};
+    string line;
+    getline(ss, line); //skip the header
+
+    //the module's own imports come first, so its own names take precedence over theirs
+    while(getline(ss, line)){
+        if(line.compare(0, 7, "import ") == 0){
+            importFile(line.substr(7).c_str());
+            continue;
+        }
+
+        unsigned int begin, end;
+        string name;
+        stringstream ls{line};
+        if(ls >> begin >> end){
+            ls.get();
+            getline(ls, name);
+            importedDecls[name] = ImportedDecl(fName, begin, end, this->scope);
+        }
+    }
+    filesBeingImported.erase(fName);
+}
+
+
+/*
+ *  Parses and registers the imported declaration of the given name, along with
+ *  any other names declared alongside it.  Returns false if no imported module
+ *  declares the name.
+ */
+bool Compiler::loadImportedDecl(string &name){
+    auto it = importedDecls.find(name);
+    if(it == importedDecls.end())
+        return false;
+
+    timing::Span span{"Import", name};
+
+    ImportedDecl decl = it->second;
+    importedDecls.erase(it);
+
+    string src = getSourceLines(decl.fileName, decl.begin, decl.end);
+    if(src.empty())
+        return false;
+
+    //the importer's lexer is restored as it is owned and later deleted by the importer
+    auto *importerLexer = yylexer;
+    int flag;
+    {
+        timing::Span parseSpan{"Parse", decl.fileName};
+        setLexer(new Lexer(decl.fileName.c_str(), src, decl.begin));
+        yy::parser p{};
+        flag = p.parse();
+        delete yylexer;
+    }
+    setLexer(importerLexer);
+
+    if(flag != PE_OK){
+        cout << "Error when importing " << decl.fileName << endl;
+        errFlag = true;
+        return false;
+    }
+
+    //register the declaration as it would have been registered when it was imported
+    string prefix = funcPrefix;
+    unsigned int curScope = scope;
+    funcPrefix = "";
+    scope = decl.scope;
+
+    parser::getRootNode()->compile(this);
+
+    funcPrefix = prefix;
+    scope = curScope;
+    return true;
+}
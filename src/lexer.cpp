@@ -1,6 +1,8 @@
 #include "lexer.h"
+#include "timing.h"
 #include <cstdlib>
 #include <cstring>
+#include <sstream>
 
 using namespace ante;
 
@@ -31,6 +33,7 @@ map<int, const char*> tokDict = {
     {Tok_C32, "C32"},
     {Tok_Bool, "Bool"},
     {Tok_Void, "Void"},
+    {Tok_VecType, "VecType"},
 
     {Tok_Eq, "=="},
     {Tok_NotEq, "!="},
@@ -169,7 +172,13 @@ void setLexer(Lexer *l){
 }
 
 int yylex(yy::parser::semantic_type* st, yy::location* yyloc){
-    return yylexer->next(yyloc);
+    if(!timing::enabled)
+        return yylexer->next(yyloc);
+
+    auto start = timing::Clock::now();
+    int tok = yylexer->next(yyloc);
+    timing::addLexTime(start);
+    return tok;
 }
 
 
@@ -190,7 +199,7 @@ Lexer::Lexer(const char* file) :
         in = new ifstream(file);
         fileName = file;
     }else{
-        in = (ifstream*) &cin;
+        in = &cin;
         fileName = "stdin";
     }
 
@@ -204,6 +213,28 @@ Lexer::Lexer(const char* file) :
     scopes->push(0);
 }
 
+/*
+ * Initializes a lexer to lex the contents of a string rather than a file.
+ * fName is only used to label the locations of tokens, and firstRow is the
+ * row the string begins at within fName.  Used by the REPL and when lazily
+ * parsing the declarations of imported modules.
+ */
+Lexer::Lexer(const char* fName, string &pseudoFile, unsigned int firstRow) :
+    fileName{fName},
+    in{new istringstream(pseudoFile)},
+    row{firstRow},
+    col{1},
+    cur{0},
+    nxt{0},
+    scopes{new stack<unsigned int>()},
+    cscope{0},
+    shouldReturnNewline(false)
+{
+    incPos();
+    incPos();
+    scopes->push(0);
+}
+
 Lexer::~Lexer(){
     delete scopes;
     if(in != &cin)
@@ -283,6 +314,41 @@ int Lexer::handleComment(yy::parser::location_type* loc){
     return next(loc);
 }
 
+/*
+ *  Returns true if name is that of a simd vector type: an integer, float, or
+ *  bool type followed by x and its number of lanes, such as f32x4 or u8x16.
+ *  The number of lanes must be a power of 2 from 2 to 64.
+ */
+bool ante::parseVectorTypeName(const string &name, TypeTag *elemTy, unsigned int *lanes){
+    static const map<string, TypeTag> elemTypes = {
+        {"i8",  TT_I8},  {"i16", TT_I16}, {"i32", TT_I32}, {"i64", TT_I64},
+        {"u8",  TT_U8},  {"u16", TT_U16}, {"u32", TT_U32}, {"u64", TT_U64},
+        {"f32", TT_F32}, {"f64", TT_F64}, {"bool", TT_Bool},
+    };
+
+    size_t x = name.rfind('x');
+    if(x == string::npos || x + 1 == name.length() || name.length() - x > 3)
+        return false;
+
+    auto elem = elemTypes.find(name.substr(0, x));
+    if(elem == elemTypes.end())
+        return false;
+
+    unsigned int n = 0;
+    for(size_t i = x + 1; i < name.length(); i++){
+        if(!IS_NUMERICAL(name[i])) return false;
+        n = n * 10 + (name[i] - '0');
+    }
+
+    if(n < 2 || n > 64 || (n & (n - 1)))
+        return false;
+
+    *elemTy = elem->second;
+    *lanes = n;
+    return true;
+}
+
+
 /*
 *  Allocates a new string for lextxt without
 *  freeing its previous value.  The previous value
@@ -324,8 +390,13 @@ int Lexer::genAlphaNumTok(yy::parser::location_type* loc){
         return Tok_UserType;
     }else{ //ident or keyword
         auto key = keywords.find(s.c_str());
+        TypeTag elemTy;
+        unsigned int lanes;
         if(key != keywords.end()){
             return key->second;
+        }else if(parseVectorTypeName(s, &elemTy, &lanes)){
+            setlextxt(&s);
+            return Tok_VecType;
         }else{//ident
             setlextxt(&s);
             return Tok_Ident;
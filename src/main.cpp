@@ -0,0 +1,10 @@
+/*
+ *      main.cpp
+ *  Entry point of ante, kept apart from the rest of the compiler so that
+ *  other programs, such as bench/micro, can link against the compiler.
+ */
+#include "compiler.h"
+
+int main(int argc, char *argv[]){
+    return ante::runAnte(argc, argv);
+}
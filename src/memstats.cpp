@@ -0,0 +1,158 @@
+/*
+ *      memstats.cpp
+ *  Memory accounting used by --mem-stats.  The ast's nodes, TypedValues,
+ *  and Variables count their own allocations through their operator new,
+ *  while copies of TypeNodes made by deepCopyTypeNode are moved into a
+ *  category of their own.  At the end of each phase of a compilation the
+ *  counts are recorded along with the peak RSS, the number of llvm
+ *  instructions in the module, and the sizes of the compiler's tables, so
+ *  the report shows how much each phase of each file allocated.
+ *
+ *  Bytes of llvm instructions and table entries are estimates from the size
+ *  of each instruction and its operands, or of each entry and its tree node.
+ */
+#include "memstats.h"
+#include "compiler.h"
+#include <sys/resource.h>
+#include <cstdio>
+
+using namespace ante;
+using namespace ante::memstats;
+
+Allocations ante::memstats::allocations[NumCategories];
+bool ante::memstats::enabled = false;
+
+const char *categoryNames[NumCategories] = {
+    "AST nodes",
+    "TypeNode copies",
+    "TypedValues",
+    "Variables",
+};
+
+
+struct MemSnapshot {
+    string phase;
+    Allocations allocs[NumCategories];
+    long peakRssKb;
+
+    unsigned long irInstructions, irBytes;
+    unsigned long varEntries, fnDeclEntries, userTypeEntries;
+
+    MemSnapshot() : peakRssKb(0), irInstructions(0), irBytes(0), varEntries(0), fnDeclEntries(0), userTypeEntries(0){
+        for(int i = 0; i < NumCategories; i++)
+            allocs[i] = {0, 0};
+    }
+};
+
+
+long getPeakRssKb(){
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss;
+}
+
+
+/*
+ *  Snapshots taken at the end of each phase.  The report is printed
+ *  when the compiler exits.
+ */
+struct MemStats {
+    vector<MemSnapshot> snapshots;
+
+    void printTable(MemSnapshot &last){
+        fprintf(stderr, "%-18s %12s %14s\n", "Category", "Count", "Bytes");
+        for(int i = 0; i < NumCategories; i++)
+            fprintf(stderr, "%-18s %12lu %14lu\n", categoryNames[i], last.allocs[i].count, last.allocs[i].bytes);
+
+        fprintf(stderr, "%-18s %12lu %14lu\n", "IR instructions", last.irInstructions, last.irBytes);
+        fprintf(stderr, "%-18s %12lu %14lu\n", "varTable entries", last.varEntries,
+                last.varEntries * (sizeof(pair<const string, Variable*>) + 4 * sizeof(void*)));
+        fprintf(stderr, "%-18s %12lu %14lu\n", "fnDecls entries", last.fnDeclEntries,
+                last.fnDeclEntries * (sizeof(pair<const string, FuncDecl*>) + 4 * sizeof(void*)));
+        fprintf(stderr, "%-18s %12lu %14lu\n", "userTypes entries", last.userTypeEntries,
+                last.userTypeEntries * (sizeof(pair<const string, DataType*>) + 4 * sizeof(void*)));
+    }
+
+    /*
+     *  Prints the change in allocations and peak RSS of each phase, along with
+     *  the size of the module and tables at the end of each phase.
+     */
+    void printPhases(){
+        fprintf(stderr, "%-32s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "Phase", "+RSS (KB)",
+                "+Nodes", "+TyCopies", "+TVals", "+Vars", "+KB", "IR insts", "varTable", "fnDecls", "userTypes");
+
+        MemSnapshot prev;
+        for(auto &s : snapshots){
+            unsigned long bytes = 0;
+            for(int i = 0; i < NumCategories; i++)
+                bytes += s.allocs[i].bytes - prev.allocs[i].bytes;
+
+            fprintf(stderr, "%-32s %10ld %10lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu\n", s.phase.c_str(),
+                    s.peakRssKb - prev.peakRssKb,
+                    s.allocs[AstNodes].count - prev.allocs[AstNodes].count,
+                    s.allocs[TypeNodeCopies].count - prev.allocs[TypeNodeCopies].count,
+                    s.allocs[TypedValues].count - prev.allocs[TypedValues].count,
+                    s.allocs[Variables].count - prev.allocs[Variables].count,
+                    bytes / 1024, s.irInstructions, s.varEntries, s.fnDeclEntries, s.userTypeEntries);
+            prev = s;
+        }
+    }
+
+    ~MemStats(){
+        if(!enabled || snapshots.empty()) return;
+
+        fprintf(stderr, "===--- Ante Memory Statistics ---===\n");
+        fprintf(stderr, "Peak RSS: %ld KB\n\n", getPeakRssKb());
+        printTable(snapshots.back());
+        fputc('\n', stderr);
+        printPhases();
+    }
+} memStats;
+
+
+/*
+ *  Moves an allocation already counted in one category to another.
+ */
+void ante::memstats::reclassify(Category from, Category to, size_t size){
+    allocations[from].count--;
+    allocations[from].bytes -= size;
+    allocations[to].count++;
+    allocations[to].bytes += size;
+}
+
+
+void ante::memstats::enable(){
+    enabled = true;
+}
+
+
+/*
+ *  Records the memory used at the end of the given phase of compiling c.
+ */
+void ante::memstats::snapshot(const char *phase, Compiler *c){
+    if(!enabled) return;
+
+    MemSnapshot s;
+    s.phase = c->fileName + ": " + phase;
+    s.peakRssKb = getPeakRssKb();
+
+    for(int i = 0; i < NumCategories; i++)
+        s.allocs[i] = allocations[i];
+
+    if(c->module){
+        for(auto &f : *c->module){
+            for(auto &bb : f){
+                for(auto &inst : bb){
+                    s.irInstructions++;
+                    s.irBytes += sizeof(Instruction) + inst.getNumOperands() * sizeof(Use);
+                }
+            }
+        }
+    }
+
+    for(auto &vars : c->varTable)
+        s.varEntries += vars->size();
+
+    s.fnDeclEntries = c->fnDecls.size();
+    s.userTypeEntries = c->userTypes.size();
+    memStats.snapshots.push_back(s);
+}
@@ -3,7 +3,7 @@
 
 
 TypedValue* Compiler::compAdd(TypedValue *l, TypedValue *r, BinOpNode *op){
-    switch(l->type->type){
+    switch(scalarTypeTag(l->type.get())){
         case TT_I8:  case TT_U8:  case TT_C8:
         case TT_I16: case TT_U16:
         case TT_I32: case TT_U32:
@@ -21,7 +21,7 @@ TypedValue* Compiler::compAdd(TypedValue *l, TypedValue *r, BinOpNode *op){
 }
 
 TypedValue* Compiler::compSub(TypedValue *l, TypedValue *r, BinOpNode *op){
-    switch(l->type->type){
+    switch(scalarTypeTag(l->type.get())){
         case TT_I8:  case TT_U8:  case TT_C8:
         case TT_I16: case TT_U16:
         case TT_I32: case TT_U32:
@@ -39,7 +39,7 @@ TypedValue* Compiler::compSub(TypedValue *l, TypedValue *r, BinOpNode *op){
 }
 
 TypedValue* Compiler::compMul(TypedValue *l, TypedValue *r, BinOpNode *op){
-    switch(l->type->type){
+    switch(scalarTypeTag(l->type.get())){
         case TT_I8:  case TT_U8:  case TT_C8:
         case TT_I16: case TT_U16:
         case TT_I32: case TT_U32:
@@ -56,7 +56,7 @@ TypedValue* Compiler::compMul(TypedValue *l, TypedValue *r, BinOpNode *op){
 }
 
 TypedValue* Compiler::compDiv(TypedValue *l, TypedValue *r, BinOpNode *op){
-    switch(l->type->type){
+    switch(scalarTypeTag(l->type.get())){
         case TT_I8:  
         case TT_I16: 
         case TT_I32: 
@@ -78,7 +78,7 @@ TypedValue* Compiler::compDiv(TypedValue *l, TypedValue *r, BinOpNode *op){
 }
 
 TypedValue* Compiler::compRem(TypedValue *l, TypedValue *r, BinOpNode *op){
-    switch(l->type->type){
+    switch(scalarTypeTag(l->type.get())){
         case TT_I8: 
         case TT_I16:
         case TT_I32:
@@ -117,7 +117,15 @@ TypedValue* Compiler::compExtract(TypedValue *l, TypedValue *r, BinOpNode *op){
         return compErr("Index of operator '[' must be an integer expression, got expression of type " + typeNodeToStr(r->type.get()), op->loc);
     }
 
-    if(l->type->type == TT_Array || l->type->type == TT_Ptr){
+    if(l->type->type == TT_Vector){
+        return new TypedValue(builder.CreateExtractElement(l->val, r->val), deepCopyTypeNode(l->type->extTy.get()));
+
+    }else if(l->type->type == TT_Slice){
+        Value *ptr = builder.CreateExtractValue(l->val, 0);
+        Value *index = builder.CreateIntCast(r->val, Type::getInt64Ty(getGlobalContext()), !isUnsignedTypeTag(r->type->type));
+        return new TypedValue(builder.CreateLoad(builder.CreateInBoundsGEP(ptr->getType()->getPointerElementType(), ptr, index)), deepCopyTypeNode(l->type->extTy.get()));
+
+    }else if(l->type->type == TT_Array || l->type->type == TT_Ptr){
         //check for alloca
         if(dynamic_cast<LoadInst*>(l->val)){
 
@@ -169,6 +177,11 @@ TypedValue* Compiler::compInsert(BinOpNode *op, Node *assignExpr){
     auto *tmp = op->lval->compile(this);
     if(!tmp) return 0;
 
+    //slices store through their pointer, and ranges assign to a sub-slice
+    auto *range = dynamic_cast<BinOpNode*>(op->rval.get());
+    if(tmp->type->type == TT_Slice || (range && range->op == Tok_Range))
+        return compSliceInsert(tmp, op, assignExpr);
+
     if(!dynamic_cast<LoadInst*>(tmp->val))
         return compErr("Variable must be mutable to insert values, but instead is an immutable " +
                 typeNodeToStr(tmp->type.get()), op->lval->loc);
@@ -200,6 +213,16 @@ TypedValue* Compiler::compInsert(BinOpNode *op, Node *assignExpr){
 
             return new TypedValue(builder.CreateStore(newVal->val, dest), mkAnonTypeNode(TT_Void));
         }
+        case TT_Vector:
+            if(!isIntTypeTag(index->type->type))
+                return compErr("Lane index must be an integer, but is a(n) " + typeNodeToStr(index->type.get()), op->rval->loc);
+
+            if(*tmp->type->extTy != *newVal->type)
+                return compErr("Cannot store a(n) " + typeNodeToStr(newVal->type.get()) + " into a lane of a(n) " +
+                        typeNodeToStr(tmp->type.get()), assignExpr->loc);
+
+            builder.CreateStore(builder.CreateInsertElement(tmp->val, newVal->val, index->val), var);
+            return getVoidLiteral();
         case TT_Tuple: case TT_Data:
             if(!dynamic_cast<ConstantInt*>(index->val)){
                 return compErr("Tuple indices must always be known at compile time.", op->loc);
@@ -244,7 +267,15 @@ TypedValue* createCast(Compiler *c, Type *castTy, TypeNode *tyn, TypedValue *val
     }
 
     //otherwise, fallback on known conversions
-    if(isIntTypeTag(valToCast->type->type)){
+    if(tyn->type == TT_Vector){
+        return c->createVector(valToCast, tyn);
+
+    }else if(tyn->type == TT_Slice){
+        auto *slice = c->toSlice(valToCast);
+        if(slice && *slice->type == *tyn)
+            return slice;
+
+    }else if(isIntTypeTag(valToCast->type->type)){
         // int -> int  (maybe unsigned)
         if(isIntTypeTag(tyn->type)){
             return new TypedValue(c->builder.CreateIntCast(valToCast->val, castTy, isUnsignedTypeTag(tyn->type)), tyn);
@@ -384,7 +415,7 @@ TypedValue* compIf(Compiler *c, IfNode *ifn, BasicBlock *mergebb, vector<pair<Ty
             blocks.push_back(thenbb);
     
             c->builder.SetInsertPoint(thenbb);
-            auto *thenVal = ifn->thenN->compile(c);
+            auto *thenVal = c->compBranch(ifn->thenN.get(), true);
             c->builder.CreateBr(mergebb);
            
             //save the 'then' value for the PhiNode after all the elifs
@@ -408,7 +439,7 @@ TypedValue* compIf(Compiler *c, IfNode *ifn, BasicBlock *mergebb, vector<pair<Ty
     }
 
     c->builder.SetInsertPoint(thenbb);
-    auto *thenVal = ifn->thenN->compile(c);
+    auto *thenVal = c->compBranch(ifn->thenN.get(), !!ifn->elseN);
     if(!thenVal) return 0;
 
     if(!dynamic_cast<ReturnInst*>(thenVal->val))
@@ -419,7 +450,8 @@ TypedValue* compIf(Compiler *c, IfNode *ifn, BasicBlock *mergebb, vector<pair<Ty
         branches.push_back({thenVal, thenbb});
 
         c->builder.SetInsertPoint(elsebb);
-        auto *elseVal = ifn->elseN->compile(c);
+        auto *elseVal = c->compBranch(ifn->elseN.get(), true);
+        if(!elseVal) return 0;
         if(!dynamic_cast<ReturnInst*>(elseVal->val))
             c->builder.CreateBr(mergebb);
         
@@ -434,6 +466,18 @@ TypedValue* compIf(Compiler *c, IfNode *ifn, BasicBlock *mergebb, vector<pair<Ty
                             " does not match the else expr's type " + typeNodeToStr(elseVal->type.get()), ifn->loc);
 
 
+        //a reference counted branch value cannot be merged with an uncounted pointer
+        bool anyRefCounted = false, anyRaw = false;
+        for(auto &pair : branches){
+            if(dynamic_cast<ReturnInst*>(pair.first->val) || pair.first->type->type != TT_Ptr)
+                continue;
+            if(isRefCounted(pair.first->type.get())) anyRefCounted = true;
+            else anyRaw = true;
+        }
+
+        if(anyRefCounted && anyRaw)
+            return c->compErr("If expression's branches mix reference counted and uncounted pointers", ifn->loc);
+
         c->builder.SetInsertPoint(mergebb);
 
         if(thenVal->type->type != TT_Void){
@@ -442,7 +486,14 @@ TypedValue* compIf(Compiler *c, IfNode *ifn, BasicBlock *mergebb, vector<pair<Ty
                 if(!dynamic_cast<ReturnInst*>(pair.first->val))
                     phi->addIncoming(pair.first->val, pair.second);
 
-            return new TypedValue(phi, thenVal->type);
+            auto *ret = new TypedValue(phi, thenVal->type);
+
+            //each branch retained its value, so the merged value is owned here instead
+            if(anyRefCounted){
+                markRefCounted(ret->type.get());
+                c->ownTemporary(ret);
+            }
+            return ret;
         }else{
             return c->getVoidLiteral();
         }
@@ -491,6 +542,16 @@ TypedValue* Compiler::compMemberAccess(Node *ln, VarNode *field, BinOpNode *bino
             tyn = tyn->extTy.get();
         }
 
+        if(tyn->type == TT_Slice){
+            if(field->name == "ptr"){
+                auto *ptrTy = mkAnonTypeNode(TT_Ptr);
+                ptrTy->extTy.reset(deepCopyTypeNode(tyn->extTy.get()));
+                return new TypedValue(builder.CreateExtractValue(val, 0), ptrTy);
+            }else if(field->name == "len"){
+                return new TypedValue(builder.CreateExtractValue(val, 1), mkAnonTypeNode(TT_U64));
+            }
+        }
+
         //check to see if this is a field index
         if(tyn->type == TT_Data || tyn->type == TT_Tuple){
             auto dataTy = lookupType(typeNodeToStr(tyn));
@@ -637,6 +698,17 @@ TypedValue* compFnCall(Compiler *c, Node *l, Node *r){
                 }
             }
 
+            //values of known length are implicitly converted to slices
+            if(paramTy->type == TT_Slice){
+                auto *slice = c->toSlice(tArg);
+                if(slice && *slice->type == *paramTy){
+                    args[i-1] = slice->val;
+                    paramTy = (TypeNode*)paramTy->next.get();
+                    i++;
+                    continue;
+                }
+            }
+
             //check for an implicit Cast function
             string castFn = typeNodeToStr(paramTy) + "_Cast";
             if(auto *fn = c->getMangledFunction(castFn, tArg->type.get())){
@@ -655,7 +727,12 @@ TypedValue* compFnCall(Compiler *c, Node *l, Node *r){
         i++;
     }
 
-    return new TypedValue(c->builder.CreateCall(f, args), deepCopyTypeNode(tvf->type->extTy.get()));
+    auto *ret = new TypedValue(c->builder.CreateCall(f, args), deepCopyTypeNode(tvf->type->extTy.get()));
+
+    //a returned reference counted pointer was retained for the caller
+    if(isRefCounted(ret->type.get()))
+        c->ownTemporary(ret);
+    return ret;
 }
 
 TypedValue* Compiler::compLogicalOr(Node *lexpr, Node *rexpr, BinOpNode *op){
@@ -746,6 +823,9 @@ TypedValue* Compiler::opImplementedForTypes(int op, TypeNode *l, TypeNode *r){
 }
 
 TypedValue* handlePrimitiveNumericOp(BinOpNode *bop, Compiler *c, TypedValue *lhs, TypedValue *rhs){
+    //vectors are operated on lane by lane, and their comparisons give a vector of bools
+    TypeTag tag = scalarTypeTag(lhs->type.get());
+
     switch(bop->op){
         case '+': return c->compAdd(lhs, rhs, bop);
         case '-': return c->compSub(lhs, rhs, bop);
@@ -753,44 +833,44 @@ TypedValue* handlePrimitiveNumericOp(BinOpNode *bop, Compiler *c, TypedValue *lh
         case '/': return c->compDiv(lhs, rhs, bop);
         case '%': return c->compRem(lhs, rhs, bop);
         case '<':
-                    if(isFPTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateFCmpOLT(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
-                    else if(isUnsignedTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateICmpULT(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                    if(isFPTypeTag(tag))
+                        return new TypedValue(c->builder.CreateFCmpOLT(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
+                    else if(isUnsignedTypeTag(tag))
+                        return new TypedValue(c->builder.CreateICmpULT(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
                     else
-                        return new TypedValue(c->builder.CreateICmpSLT(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                        return new TypedValue(c->builder.CreateICmpSLT(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
         case '>':
-                    if(isFPTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateFCmpOGT(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
-                    else if(isUnsignedTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateICmpUGT(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                    if(isFPTypeTag(tag))
+                        return new TypedValue(c->builder.CreateFCmpOGT(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
+                    else if(isUnsignedTypeTag(tag))
+                        return new TypedValue(c->builder.CreateICmpUGT(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
                     else
-                        return new TypedValue(c->builder.CreateICmpSGT(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                        return new TypedValue(c->builder.CreateICmpSGT(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
         case '^': return new TypedValue(c->builder.CreateXor(lhs->val, rhs->val), lhs->type);
         case Tok_Eq:
-                    if(isFPTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateFCmpOEQ(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                    if(isFPTypeTag(tag))
+                        return new TypedValue(c->builder.CreateFCmpOEQ(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
                     else
-                        return new TypedValue(c->builder.CreateICmpEQ(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                        return new TypedValue(c->builder.CreateICmpEQ(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
         case Tok_NotEq:
-                    if(isFPTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateFCmpONE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                    if(isFPTypeTag(tag))
+                        return new TypedValue(c->builder.CreateFCmpONE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
                     else
-                        return new TypedValue(c->builder.CreateICmpNE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                        return new TypedValue(c->builder.CreateICmpNE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
         case Tok_LesrEq:
-                    if(isFPTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateFCmpOLE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
-                    else if(isUnsignedTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateICmpULE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                    if(isFPTypeTag(tag))
+                        return new TypedValue(c->builder.CreateFCmpOLE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
+                    else if(isUnsignedTypeTag(tag))
+                        return new TypedValue(c->builder.CreateICmpULE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
                     else
-                        return new TypedValue(c->builder.CreateICmpSLE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                        return new TypedValue(c->builder.CreateICmpSLE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
         case Tok_GrtrEq:
-                    if(isFPTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateFCmpOGE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
-                    else if(isUnsignedTypeTag(lhs->type->type))
-                        return new TypedValue(c->builder.CreateICmpUGE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                    if(isFPTypeTag(tag))
+                        return new TypedValue(c->builder.CreateFCmpOGE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
+                    else if(isUnsignedTypeTag(tag))
+                        return new TypedValue(c->builder.CreateICmpUGE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
                     else
-                        return new TypedValue(c->builder.CreateICmpSGE(lhs->val, rhs->val), mkAnonTypeNode(TT_Bool));
+                        return new TypedValue(c->builder.CreateICmpSGE(lhs->val, rhs->val), mkCmpTypeNode(lhs->type.get()));
         default:
             return c->compErr("Operator " + Lexer::getTokStr(bop->op) + " is not overloaded for types "
                    + typeNodeToStr(lhs->type.get()) + " and " + typeNodeToStr(rhs->type.get()), bop->loc);
@@ -809,6 +889,13 @@ TypedValue* BinOpNode::compile(Compiler *c){
     }
 
 
+    //x#(start..end) creates a slice rather than compiling the range
+    auto *range = dynamic_cast<BinOpNode*>(rval.get());
+    if(op == '#' && range && range->op == Tok_Range){
+        auto *lhs = lval->compile(c);
+        return lhs ? c->compSubSlice(lhs, range) : 0;
+    }
+
     TypedValue *lhs = lval->compile(c);
     TypedValue *rhs = rval->compile(c);
     if(!lhs || !rhs) return 0;
@@ -816,6 +903,14 @@ TypedValue* BinOpNode::compile(Compiler *c){
     if(op == ';') return rhs;
     if(op == '#') return c->compExtract(lhs, rhs, this);
 
+    if((op == Tok_Eq || op == Tok_NotEq) && (lhs->type->type == TT_Slice || rhs->type->type == TT_Slice))
+        return c->compSliceEq(lhs, rhs, this);
+
+    if(lhs->type->type == TT_Vector || rhs->type->type == TT_Vector){
+        if(!c->matchVectorOperands(&lhs, &rhs, this)) return 0;
+        return handlePrimitiveNumericOp(this, c, lhs, rhs);
+    }
+
 
     //Check if both Values are numeric, and if so, check if their types match.
     //If not, do an implicit conversion (usually a widening) to match them.
@@ -866,6 +961,10 @@ unsigned long getSizeInBits(Compiler *c, TypeNode *t){
     switch(t->type){
         case TT_Ptr: case TT_Array: case TT_Function: case TT_Method:
             return 64;
+        case TT_Slice:
+            return 128;
+        case TT_Vector:
+            return getSizeInBits(c, t->extTy.get()) * getVectorLanes(t);
         case TT_Tuple:{
             TypeNode *ext = t->extTy.get();
             unsigned long sum = 0;
@@ -911,33 +1010,22 @@ TypedValue* UnOpNode::compile(Compiler *c){
         case Tok_Not:
             return new TypedValue(c->builder.CreateNot(rhs->val), rhs->type);
         case Tok_New:
-            //the 'new' keyword in ante creates a reference to any existing value
+            //the 'new' keyword in ante creates a reference counted pointer to a copy of any existing value
 
             if(rhs->getType()->isSized()){
-                string mallocFnName = "malloc";
-                Function* mallocFn = (Function*)c->getFunction(mallocFnName)->val;
-
                 unsigned size = getSizeInBits(c, rhs->type.get()) / 8;
 
-                Value *sizeVal = ConstantInt::get(getGlobalContext(), APInt(32, size, true));
-
-                Value *voidPtr = c->builder.CreateCall(mallocFn, sizeVal);
                 Type *ptrTy = rhs->getType()->getPointerTo();
-                Value *typedPtr = c->builder.CreatePointerCast(voidPtr, ptrTy);
+                Value *typedPtr = c->createRcAlloc(size, ptrTy);
 
-                //finally store rhs into the malloc'd slot
+                //finally store rhs into the allocated slot
                 c->builder.CreateStore(rhs->val, typedPtr);
 
-                TypeNode *tyn = mkAnonTypeNode(TT_Ptr);
-                tyn->extTy.reset(deepCopyTypeNode(rhs->type.get()));
-
+                TypeNode *tyn = mkRefCountedPtrTypeNode(deepCopyTypeNode(rhs->type.get()));
                 auto *ret = new TypedValue(typedPtr, tyn);
 
-
-                //Create an upper-case name so it cannot be referenced normally
-                string tmpAllocName = "_New" + to_string((unsigned long)ret);
-                c->stoVar(tmpAllocName, new Variable(tmpAllocName, ret, c->scope, false /*always free*/));
-
+                //the new value's first reference is released at the end of this scope
+                c->ownTemporary(ret);
                 return ret;
             }
     }
@@ -0,0 +1,208 @@
+/*
+ *      ownership.cpp
+ *  Last-use analysis of owned references.  Each owner of a reference
+ *  counted pointer releases it at the end of its lexical scope, which in a
+ *  long-running block can be long after the value was last used.  Once
+ *  every function is compiled and inlined, each release is moved up to just
+ *  after the last use of its pointer, freeing the value as early as possible.
+ *
+ *  A release is moved from its block to an earlier block that dominates it,
+ *  is post-dominated by it, and is within the same loop, so that it is still
+ *  run exactly once for each time its pointer is created.  It cannot move
+ *  above any use of its pointer that could still be reached afterward.
+ *  Pointers that may be copied into another value, by being stored, put in
+ *  an aggregate, merged by a phi or select, or returned from a call, are
+ *  never moved, as the later uses of the copy cannot be found.
+ *
+ *  Returning an owned pointer retains it for the caller before the function's
+ *  own reference is released, and once that release is moved next to the
+ *  retain, optimizeRefCounts removes the pair, so the reference is moved to
+ *  the caller rather than counted twice.  Pointers passed to functions are
+ *  borrowed for the call, so their release simply follows the call.
+ */
+#include "compiler.h"
+#include "timing.h"
+#include <llvm/IR/Dominators.h>
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/Analysis/LoopInfo.h>
+
+using namespace ante;
+
+
+/*
+ *  Adds each instruction using ptr, or a pointer derived from it by a cast
+ *  or getelementptr, to uses, other than releases of it.  Returns false if
+ *  ptr could be copied into another value, such as by being stored, inserted
+ *  into an aggregate, merged by a phi or select, or returned by a call, as
+ *  the later uses of the copy cannot then be found.
+ */
+bool collectUses(Value *ptr, set<Instruction*> &uses){
+    for(auto *user : ptr->users()){
+        auto *inst = dynamic_cast<Instruction*>(user);
+        if(!inst) return false;
+
+        if(dynamic_cast<LoadInst*>(inst) || dynamic_cast<ICmpInst*>(inst)){
+            uses.insert(inst);
+
+        }else if(dynamic_cast<CastInst*>(inst) || dynamic_cast<GetElementPtrInst*>(inst)){
+            if(!inst->getType()->isPointerTy() || !collectUses(inst, uses))
+                return false;
+
+        }else if(auto *store = dynamic_cast<StoreInst*>(inst)){
+            if(store->getValueOperand() == ptr)
+                return false;
+            uses.insert(inst);
+
+        }else if(auto *call = dynamic_cast<CallInst*>(inst)){
+            //a call returning a pointer or aggregate may return a copy of ptr
+            Type *retTy = call->getType();
+            if(!call->getCalledFunction() || retTy->isPointerTy() || retTy->isAggregateType())
+                return false;
+
+            if(!isRcCall(call, "__rc_release"))
+                uses.insert(call);
+
+        }else{
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ *  Returns the last of uses, or def, in bb before the instruction end,
+ *  or nullptr if there are none.  If end is nullptr all of bb is searched.
+ */
+Instruction* lastUseIn(BasicBlock *bb, Instruction *end, set<Instruction*> &uses, Instruction *def){
+    Instruction *last = nullptr;
+    for(auto &inst : *bb){
+        if(&inst == end) break;
+        if(&inst == def || uses.count(&inst))
+            last = &inst;
+    }
+    return last;
+}
+
+
+/*
+ *  Returns true if any of uses could be run after the instruction after
+ *  in bb, or after the start of bb if after is nullptr.  Uses reached only
+ *  by passing through the block defining their pointer are of a later
+ *  instance of it, created on another iteration of a loop, and are ignored.
+ */
+bool usedAfter(BasicBlock *bb, Instruction *after, set<Instruction*> &uses, Instruction *def){
+    auto it = after ? ++BasicBlock::iterator(after) : bb->begin();
+    for(; it != bb->end(); ++it)
+        if(uses.count(&*it))
+            return true;
+
+    set<BasicBlock*> visited;
+    vector<BasicBlock*> worklist(succ_begin(bb), succ_end(bb));
+    while(!worklist.empty()){
+        BasicBlock *next = worklist.back();
+        worklist.pop_back();
+
+        if(next == def->getParent() || !visited.insert(next).second)
+            continue;
+
+        for(auto &inst : *next)
+            if(uses.count(&inst))
+                return true;
+
+        worklist.insert(worklist.end(), succ_begin(next), succ_end(next));
+    }
+    return false;
+}
+
+
+/*
+ *  Moves the given release to just after the last use of the pointer it
+ *  releases, if that is earlier.  Returns true if it was moved.
+ */
+bool moveToLastUse(CallInst *release, DominatorTree &dt, DominatorTreeBase<BasicBlock> &pdt, LoopInfo &li){
+    Value *arg = release->getArgOperand(0);
+    auto *ptr = dynamic_cast<Instruction*>(arg->stripPointerCasts());
+    if(!ptr) return false;
+
+    set<Instruction*> uses;
+    if(!collectUses(ptr, uses))
+        return false;
+
+    BasicBlock *releaseBB = release->getParent();
+    Loop *loop = li.getLoopFor(releaseBB);
+
+    //walk up the dominator tree to the last use, remembering the earliest block
+    //the release could be run at the start of
+    Instruction *pos = nullptr;
+    for(auto *node = dt.getNode(releaseBB); node; node = node->getIDom()){
+        BasicBlock *bb = node->getBlock();
+        bool canHold = li.getLoopFor(bb) == loop && pdt.dominates(releaseBB, bb);
+
+        Instruction *last = lastUseIn(bb, bb == releaseBB ? release : nullptr, uses, ptr);
+        if(last){
+            if(canHold && !dynamic_cast<TerminatorInst*>(last) && !usedAfter(bb, last, uses, ptr))
+                pos = dynamic_cast<PHINode*>(last) ? &*bb->getFirstInsertionPt() : &*++BasicBlock::iterator(last);
+            break;
+        }
+
+        if(canHold){
+            if(usedAfter(bb, nullptr, uses, ptr))
+                break;
+            pos = &*bb->getFirstInsertionPt();
+        }
+    }
+
+    if(!pos || pos == release || pos == arg)
+        return false;
+
+    //the release's argument is recast at its new position, where the old cast may not be defined
+    IRBuilder<> b{pos};
+    release->setArgOperand(0, b.CreatePointerCast(ptr, arg->getType()));
+    release->moveBefore(pos);
+
+    auto *oldCast = dynamic_cast<Instruction*>(arg);
+    if(oldCast && oldCast != ptr && oldCast->use_empty())
+        oldCast->eraseFromParent();
+    return true;
+}
+
+
+/*
+ *  Moves each release in the module to just after the last use of the
+ *  pointer it releases, printing how many were moved if --alloc-report was
+ *  given.  Must be run after inlining and before optimizeRefCounts, which
+ *  can then remove the retains and releases this brings together.
+ */
+void Compiler::releaseAtLastUse(){
+    timing::Span span{"Last use analysis", fileName};
+    unsigned int moved = 0, total = 0;
+
+    for(auto &f : *module){
+        if(f.isDeclaration())
+            continue;
+
+        vector<CallInst*> releases;
+        for(auto &bb : f)
+            for(auto &inst : bb)
+                if(isRcCall(&inst, "__rc_release"))
+                    releases.push_back((CallInst*)&inst);
+
+        if(releases.empty())
+            continue;
+
+        DominatorTree dt{f};
+        DominatorTreeBase<BasicBlock> pdt{true};
+        pdt.recalculate(f);
+        LoopInfo li{dt};
+
+        total += releases.size();
+        for(auto *release : releases)
+            if(moveToLastUse(release, dt, pdt, li))
+                moved++;
+    }
+
+    if(options.allocReport)
+        fprintf(stderr, "%s: moved %u of %u releases to the last use of their value\n",
+                fileName.c_str(), moved, total);
+}
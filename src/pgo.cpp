@@ -0,0 +1,77 @@
+/*
+ *      pgo.cpp
+ *  Profile-guided optimization.  With --profile-generate every module is
+ *  instrumented with counters for each edge and function entry, and the
+ *  program writes these counts to <program>.profraw when it exits.  Once
+ *  merged with llvm-profdata, --profile-use=<file> annotates each module
+ *  with the recorded branch weights and function entry counts before it is
+ *  inlined and passed to codegen, where block placement lays out the hot
+ *  path of each function contiguously.  Functions never entered during the
+ *  profiled run are marked cold so calls to them are treated as unlikely.
+ */
+#include "compiler.h"
+#include "cache.h"
+#include <llvm/Transforms/Instrumentation.h>
+#include <llvm/Transforms/IPO.h>
+#include <fstream>
+#include <sstream>
+
+using namespace ante;
+
+CompilerOptions ante::options;
+
+
+/*
+ *  Returns the part of an output's cache key determined by the profile options,
+ *  covering the contents of the profile used, if any.
+ */
+string ante::getProfileFlags(){
+    string flags;
+    if(options.profileGenerate)
+        flags += " profile-generate";
+
+    if(!options.profileUse.empty()){
+        ifstream f{options.profileUse};
+        stringstream ss;
+        ss << f.rdbuf();
+        flags += " profile-use " + cache::hash(ss.str());
+    }
+    return flags;
+}
+
+
+/*
+ *  Marks each function the profile shows was never entered as cold.
+ */
+void markColdFunctions(Module *m){
+    for(auto &f : *m){
+        auto count = f.getEntryCount();
+        if(!f.isDeclaration() && count.hasValue() && count.getValue() == 0)
+            f.addFnAttr(Attribute::Cold);
+    }
+}
+
+
+/*
+ *  Instruments or optimizes the module according to the profile options.  Must
+ *  be run on a fully compiled module before it is passed to codegen.
+ */
+void Compiler::runProfilePasses(){
+    if(options.profileGenerate){
+        InstrProfOptions opts;
+        //only the program's own module sets where its profile is written
+        if(!isLib)
+            opts.InstrProfileOutput = removeFileExt(fileName) + ".profraw";
+
+        legacy::PassManager pm;
+        pm.add(createPGOInstrumentationGenPass());
+        pm.add(createInstrProfilingPass(opts));
+        pm.run(*module);
+    }else if(!options.profileUse.empty()){
+        legacy::PassManager pm;
+        pm.add(createPGOInstrumentationUsePass(options.profileUse));
+        pm.add(createFunctionInliningPass());
+        pm.run(*module);
+        markColdFunctions(module.get());
+    }
+}
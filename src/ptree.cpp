@@ -152,6 +152,17 @@ Node* mkTypeNode(yy::parser::location_type loc, TypeTag type, char* typeName, No
     return new TypeNode(loc, type, typeName, static_cast<TypeNode*>(extTy));
 }
 
+/*
+ *  Creates the type of a simd vector from its name, eg. f32x4.  The
+ *  element type is its extTy, and the name is kept as its typeName.
+ */
+Node* mkVecTypeNode(yy::parser::location_type loc, char* typeName){
+    TypeTag elemTy;
+    unsigned int lanes;
+    parseVectorTypeName(typeName, &elemTy, &lanes);
+    return new TypeNode(loc, TT_Vector, typeName, new TypeNode(loc, elemTy, "", nullptr));
+}
+
 Node* mkTypeCastNode(yy::parser::location_type loc, Node *l, Node *r){
     return new TypeCastNode(loc, static_cast<TypeNode*>(l), r);
 }
@@ -179,6 +190,7 @@ TypeNode* deepCopyTypeNode(const TypeNode *n){
     yy::location loc = {yy::position(n->loc.begin.filename, n->loc.begin.line, n->loc.begin.column), 
                         yy::position(n->loc.end.filename,   n->loc.end.line,   n->loc.end.column)};
     TypeNode *cpy = new TypeNode(loc, n->type, n->typeName, nullptr);
+    memstats::reclassify(memstats::AstNodes, memstats::TypeNodeCopies, sizeof(TypeNode));
 
     if(n->type == TT_Tuple || n->type == TT_Data || n->type == TT_Function || n->type == TT_Method){
         TypeNode *nxt = n->extTy.get();
@@ -191,7 +203,7 @@ TypeNode* deepCopyTypeNode(const TypeNode *n){
             ext->next.reset(deepCopyTypeNode(nxt));
             ext = static_cast<TypeNode*>(ext->next.get());
         }
-    }else if(n->type == TT_Array || n->type == TT_Ptr){
+    }else if(n->type == TT_Array || n->type == TT_Slice || n->type == TT_Ptr || n->type == TT_Vector){
         cpy->extTy.reset(deepCopyTypeNode(n->extTy.get()));
     }
     return cpy;
@@ -0,0 +1,443 @@
+/*
+ *      refcount.cpp
+ *  Reference counted pointers.  Values created with new are preceded by a
+ *  16 byte header whose last 8 bytes count the references to the value, so
+ *  a pointer to one can still be used anywhere a raw pointer is expected.
+ *  The temporary created by new, each var the pointer is stored in, and the
+ *  caller of a function returning it each own a reference which is released
+ *  when their scope ends.  Pointers passed to functions are borrowed and
+ *  are not counted.  Reference counted pointers are TT_Ptr types named "rc",
+ *  so they compare equal to raw pointers of the same element type.
+ *
+ *  Once every function is compiled and ![inline] functions are inlined, a
+ *  retain followed by a release of the same pointer within a block, with
+ *  nothing in between which could release it, are both removed.  An
+ *  allocation that is then never retained and only escapes to functions
+ *  which neither write through nor capture it has a single owner, so it
+ *  is demoted to a plain malloc freed by its releases.  The escape analysis
+ *  of escape.cpp may then move it to the stack or to static storage.
+ */
+#include "compiler.h"
+#include "timing.h"
+
+using namespace ante;
+
+//bytes before each reference counted value, the last 8 of which hold its count
+#define RC_HEADER_BYTES 16
+
+
+bool isRefCounted(const TypeNode *t){
+    return t && t->type == TT_Ptr && t->typeName == "rc";
+}
+
+
+void markRefCounted(TypeNode *ptrTy){
+    ptrTy->typeName = "rc";
+}
+
+
+TypeNode* mkRefCountedPtrTypeNode(TypeNode *elemTy){
+    auto *ptrTy = mkAnonTypeNode(TT_Ptr);
+    markRefCounted(ptrTy);
+    ptrTy->extTy.reset(elemTy);
+    return ptrTy;
+}
+
+
+/*
+ *  Returns a pointer to the count of the reference counted value at p
+ */
+Value* getCountPtr(IRBuilder<> &b, Value *p){
+    Value *count = b.CreateConstInBoundsGEP1_64(p, -8);
+    return b.CreatePointerCast(count, Type::getInt64PtrTy(getGlobalContext()));
+}
+
+
+/*
+ *  Defines __rc_alloc: u64 size -> u8*, which allocates a value of the
+ *  given size with a count of 1.
+ */
+void defineRcAlloc(Compiler *c, Function *f){
+    string mallocFnName = "malloc";
+    Function *mallocFn = (Function*)c->getFunction(mallocFnName)->val;
+    Type *sizeTy = mallocFn->getFunctionType()->getParamType(0);
+
+    IRBuilder<> b{BasicBlock::Create(getGlobalContext(), "entry", f)};
+    Value *size = b.CreateAdd(&*f->arg_begin(), b.getInt64(RC_HEADER_BYTES));
+    Value *header = b.CreateCall(mallocFn, b.CreateZExtOrTrunc(size, sizeTy));
+    header = b.CreatePointerCast(header, b.getInt8PtrTy());
+
+    Value *p = b.CreateConstInBoundsGEP1_64(header, RC_HEADER_BYTES);
+    b.CreateStore(b.getInt64(1), getCountPtr(b, p));
+    b.CreateRet(p);
+}
+
+
+/*
+ *  Defines __rc_retain: u8* p, which increments the count of p if it is not null.
+ */
+void defineRcRetain(Function *f){
+    auto *entry = BasicBlock::Create(getGlobalContext(), "entry", f);
+    auto *retain = BasicBlock::Create(getGlobalContext(), "retain", f);
+    auto *end = BasicBlock::Create(getGlobalContext(), "end", f);
+    Value *p = &*f->arg_begin();
+
+    IRBuilder<> b{entry};
+    b.CreateCondBr(b.CreateIsNull(p), end, retain);
+
+    b.SetInsertPoint(retain);
+    Value *countPtr = getCountPtr(b, p);
+    b.CreateStore(b.CreateAdd(b.CreateLoad(countPtr), b.getInt64(1)), countPtr);
+    b.CreateBr(end);
+
+    b.SetInsertPoint(end);
+    b.CreateRetVoid();
+}
+
+
+/*
+ *  Defines __rc_release: u8* p, which decrements the count of p if it
+ *  is not null, freeing it if this was its last reference.
+ */
+void defineRcRelease(Compiler *c, Function *f){
+    string freeFnName = "free";
+    Function *freeFn = (Function*)c->getFunction(freeFnName)->val;
+
+    auto *entry = BasicBlock::Create(getGlobalContext(), "entry", f);
+    auto *release = BasicBlock::Create(getGlobalContext(), "release", f);
+    auto *dealloc = BasicBlock::Create(getGlobalContext(), "free", f);
+    auto *store = BasicBlock::Create(getGlobalContext(), "store", f);
+    auto *end = BasicBlock::Create(getGlobalContext(), "end", f);
+    Value *p = &*f->arg_begin();
+
+    IRBuilder<> b{entry};
+    b.CreateCondBr(b.CreateIsNull(p), end, release);
+
+    b.SetInsertPoint(release);
+    Value *countPtr = getCountPtr(b, p);
+    Value *count = b.CreateSub(b.CreateLoad(countPtr), b.getInt64(1));
+    b.CreateCondBr(b.CreateICmpEQ(count, b.getInt64(0)), dealloc, store);
+
+    b.SetInsertPoint(dealloc);
+    Value *header = b.CreateConstInBoundsGEP1_64(p, -RC_HEADER_BYTES);
+    Type *voidPtr = freeFn->getFunctionType()->getParamType(0);
+    b.CreateCall(freeFn, b.CreatePointerCast(header, voidPtr));
+    b.CreateBr(end);
+
+    b.SetInsertPoint(store);
+    b.CreateStore(count, countPtr);
+    b.CreateBr(end);
+
+    b.SetInsertPoint(end);
+    b.CreateRetVoid();
+}
+
+
+/*
+ *  Returns the given reference counting function, defining it in
+ *  this module if it has not yet been.
+ */
+Function* Compiler::getRcFunction(const string &name){
+    Function *f = module->getFunction(name);
+    if(f && !f->isDeclaration())
+        return f;
+
+    Type *u8Ptr = Type::getInt8PtrTy(getGlobalContext());
+    if(!f){
+        FunctionType *ft = name == "__rc_alloc"
+            ? FunctionType::get(u8Ptr, {Type::getInt64Ty(getGlobalContext())}, false)
+            : FunctionType::get(Type::getVoidTy(getGlobalContext()), {u8Ptr}, false);
+
+        f = Function::Create(ft, Function::LinkOnceODRLinkage, name, module.get());
+    }else{
+        //declared by a function linked in from the cache
+        f->setLinkage(Function::LinkOnceODRLinkage);
+    }
+    f->addFnAttr(Attribute::NoUnwind);
+
+    if(name == "__rc_alloc")
+        defineRcAlloc(this, f);
+    else if(name == "__rc_retain")
+        defineRcRetain(f);
+    else
+        defineRcRelease(this, f);
+    return f;
+}
+
+
+/*
+ *  Allocates a reference counted value of the given size in bytes with a
+ *  single reference, returning a pointer to it of type ptrTy.
+ */
+Value* Compiler::createRcAlloc(unsigned int size, Type *ptrTy){
+    Value *p = builder.CreateCall(getRcFunction("__rc_alloc"), builder.getInt64(size));
+    return builder.CreatePointerCast(p, ptrTy);
+}
+
+
+void Compiler::createRetain(Value *p){
+    builder.CreateCall(getRcFunction("__rc_retain"), builder.CreatePointerCast(p, builder.getInt8PtrTy()));
+}
+
+
+void Compiler::createRelease(Value *p){
+    builder.CreateCall(getRcFunction("__rc_release"), builder.CreatePointerCast(p, builder.getInt8PtrTy()));
+}
+
+
+/*
+ *  Gives the reference held by tval, a reference counted pointer which
+ *  has just been created or returned, to a hidden variable of the current
+ *  scope so that it is released when the scope ends.
+ */
+void Compiler::ownTemporary(TypedValue *tval){
+    auto *tmp = new TypedValue(tval->val, tval->type);
+
+    //Create an upper-case name so it cannot be referenced normally
+    string tmpName = "_New" + to_string((unsigned long)tmp);
+    stoVar(tmpName, new Variable(tmpName, tmp, scope, false /*always free*/));
+}
+
+
+/*
+ *  Compiles one branch of an if, match, or loop body in its own scope so
+ *  that the temporaries it owns are released within the branch, the only
+ *  place they are known to have been created.  If keepResult is set and the
+ *  branch's value is reference counted it is retained, and the caller then
+ *  owns the value merged from each branch.
+ */
+TypedValue* Compiler::compBranch(Node *branch, bool keepResult){
+    enterNewScope();
+    TypedValue *val = branch->compile(this);
+
+    if(val && keepResult && isRefCounted(val->type.get()) && !dynamic_cast<ReturnInst*>(val->val))
+        createRetain(val->val);
+
+    exitScope();
+    return val;
+}
+
+
+/*
+ *  Records that the function being compiled returns ret.  Reports an error
+ *  and returns false if it also returns a pointer of the other kind, as its
+ *  callers could not know whether they own what it returns.
+ */
+bool Compiler::recordReturn(TypedValue *ret, yy::location &loc){
+    if(fnReturns.empty() || ret->type->type != TT_Ptr)
+        return true;
+
+    auto &rets = fnReturns.back();
+    if(isRefCounted(ret->type.get()))
+        rets.refCounted = true;
+    else
+        rets.raw = true;
+
+    if(rets.refCounted && rets.raw){
+        compErr("Function returns both reference counted and uncounted pointers", loc);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ *  Releases the references owned by every scope an explicit return of ret
+ *  leaves, down to the outermost scope of the function being compiled.  If
+ *  ret is reference counted, the reference of one of its owners is moved to
+ *  the caller rather than released, or if it has none the caller is given
+ *  a new one.  The scopes are only left on this path, so their variables
+ *  are still released normally where their scopes end.
+ */
+void Compiler::releaseOnReturn(TypedValue *ret){
+    bool refCounted = isRefCounted(ret->type.get());
+    if(fnReturns.empty()){
+        if(refCounted) createRetain(ret->val);
+        return;
+    }
+
+    vector<Variable*> owners;
+    Variable *moved = nullptr;
+    for(unsigned int level = varTable.size(); level >= fnReturns.back().scope && level > 0; level--){
+        for(auto &it : *varTable[level-1]){
+            Variable *var = it.second;
+            if(!var->isFreeable() || var->scope != level || !isRefCounted(var->tval->type.get()))
+                continue;
+
+            if(refCounted && !moved && var->getVal() == ret->val)
+                moved = var;
+            else
+                owners.push_back(var);
+        }
+    }
+
+    //retained before any release so that releasing another owner cannot free it
+    if(refCounted && !moved)
+        createRetain(ret->val);
+
+    for(auto *var : owners){
+        auto *alloca = dynamic_cast<AllocaInst*>(var->getVal());
+        createRelease(alloca ? builder.CreateLoad(alloca) : var->getVal());
+    }
+}
+
+
+/*
+ *  Returns true if inst is a call to the given reference counting function
+ */
+bool isRcCall(Instruction *inst, const char *name){
+    auto *call = dynamic_cast<CallInst*>(inst);
+    return call && call->getCalledFunction() && call->getCalledFunction()->getName() == name;
+}
+
+
+/*
+ *  Returns true if the given call could release a reference.  Functions
+ *  only declared in this module are assumed to be external C functions,
+ *  which cannot release the references of Ante values.
+ */
+bool mayRelease(CallInst *call){
+    Function *callee = call->getCalledFunction();
+    if(!callee) return true;
+
+    StringRef name = callee->getName();
+    if(name == "__rc_release") return true;
+    if(name == "__rc_retain" || name == "__rc_alloc") return false;
+
+    return !callee->isDeclaration() && !callee->onlyReadsMemory();
+}
+
+
+/*
+ *  Removes each retain of a pointer that is followed within its block by a
+ *  release of the same pointer, along with the release, provided nothing
+ *  between them may release a reference.  Returns the number of pairs removed.
+ */
+unsigned int elideRetainReleasePairs(Function &f){
+    set<Instruction*> removed;
+
+    for(auto &bb : f){
+        for(auto it = bb.begin(); it != bb.end(); ++it){
+            if(!isRcCall(&*it, "__rc_retain"))
+                continue;
+
+            Value *p = it->getOperand(0)->stripPointerCasts();
+            for(auto next = std::next(it); next != bb.end(); ++next){
+                auto *call = dynamic_cast<CallInst*>(&*next);
+                if(!call || removed.count(call))
+                    continue;
+
+                if(isRcCall(call, "__rc_release") && call->getArgOperand(0)->stripPointerCasts() == p){
+                    removed.insert(&*it);
+                    removed.insert(call);
+                    break;
+                }
+
+                if(mayRelease(call))
+                    break;
+            }
+        }
+    }
+
+    for(auto *inst : removed)
+        inst->eraseFromParent();
+    return removed.size() / 2;
+}
+
+
+/*
+ *  Returns true if the value ptr points to can never have more than one
+ *  reference: neither ptr nor any pointer derived from it is retained,
+ *  stored, returned, merged by a phi or select, or passed to a function
+ *  that may capture it.  Otherwise, each release of it is appended to releases.
+ */
+bool isUnique(Value *ptr, vector<CallInst*> &releases){
+    for(auto *user : ptr->users()){
+        if(dynamic_cast<LoadInst*>(user) || dynamic_cast<ICmpInst*>(user))
+            continue;
+
+        if(auto *store = dynamic_cast<StoreInst*>(user)){
+            if(store->getValueOperand() == ptr)
+                return false;
+
+        }else if(dynamic_cast<CastInst*>(user) || dynamic_cast<GetElementPtrInst*>(user)){
+            if(!user->getType()->isPointerTy() || !isUnique(user, releases))
+                return false;
+
+        }else if(auto *call = dynamic_cast<CallInst*>(user)){
+            if(isRcCall(call, "__rc_release"))
+                releases.push_back(call);
+            else if(!passesReadOnly(call, ptr))
+                return false;
+
+        }else{
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ *  Replaces a uniquely owned reference counted allocation with a call
+ *  to malloc, and each release of it with a call to free.
+ */
+void demoteToMalloc(Compiler *c, CallInst *alloc, vector<CallInst*> &releases){
+    string mallocFnName = "malloc", freeFnName = "free";
+    Function *mallocFn = (Function*)c->getFunction(mallocFnName)->val;
+    Function *freeFn = (Function*)c->getFunction(freeFnName)->val;
+
+    IRBuilder<> b{alloc};
+    Type *sizeTy = mallocFn->getFunctionType()->getParamType(0);
+    Value *p = b.CreateCall(mallocFn, b.CreateZExtOrTrunc(alloc->getArgOperand(0), sizeTy));
+    alloc->replaceAllUsesWith(b.CreatePointerCast(p, alloc->getType()));
+    alloc->eraseFromParent();
+
+    Type *voidPtr = freeFn->getFunctionType()->getParamType(0);
+    for(auto *release : releases){
+        b.SetInsertPoint(release);
+        b.CreateCall(freeFn, b.CreatePointerCast(release->getArgOperand(0), voidPtr));
+        release->eraseFromParent();
+    }
+}
+
+
+/*
+ *  Removes redundant retains and releases, and demotes each uniquely owned
+ *  reference counted allocation to a malloc, printing how many of each
+ *  there were if --alloc-report was given.  Must be run after inlining and
+ *  before promoteHeapAllocations, and leaves the reference counting
+ *  functions to be inlined afterward.
+ */
+void Compiler::optimizeRefCounts(){
+    timing::Span span{"Reference count optimization", fileName};
+    unsigned int pairs = 0, unique = 0, total = 0;
+
+    //functions linked in from the cache may use these without defining them
+    for(auto *name : {"__rc_alloc", "__rc_retain", "__rc_release"})
+        if(module->getFunction(name))
+            getRcFunction(name)->addFnAttr(Attribute::AlwaysInline);
+
+    for(auto &f : *module){
+        pairs += elideRetainReleasePairs(f);
+
+        vector<CallInst*> allocs;
+        for(auto &bb : f)
+            for(auto &inst : bb)
+                if(isRcCall(&inst, "__rc_alloc"))
+                    allocs.push_back((CallInst*)&inst);
+
+        total += allocs.size();
+        for(auto *alloc : allocs){
+            vector<CallInst*> releases;
+            if(isUnique(alloc, releases)){
+                demoteToMalloc(this, alloc, releases);
+                unique++;
+            }
+        }
+    }
+
+    if(options.allocReport)
+        fprintf(stderr, "%s: removed %u retain/release pairs, %u of %u reference counted allocations are unique\n",
+                fileName.c_str(), pairs, unique, total);
+}
@@ -0,0 +1,217 @@
+/*
+ *      repl.cpp
+ *  Interactive read-eval-print loop used by ante -e.  Each input is
+ *  compiled into its own module which is added to a single persistent
+ *  JIT, so previous definitions never need to be recompiled.
+ */
+#include "compiler.h"
+#include "yyparser.h"
+#include "llvm/ExecutionEngine/GenericValue.h"
+
+#include <cstdio>
+
+using namespace ante;
+
+/*
+ *  Keywords that begin a definition spanning multiple lines.
+ */
+const vector<string> replBlockStarts = {"fun", "type", "ext", "trait", "!["};
+
+/*
+ *  Keywords/symbols that, when ending a line, signal the start of an indented block.
+ */
+const vector<string> replBlockEnds = {":", "=", "then", "else", "do", "with"};
+
+
+bool startsWith(string &s, const string &prefix){
+    return s.compare(0, prefix.length(), prefix) == 0;
+}
+
+bool endsWith(string &s, const string &suffix){
+    return s.length() >= suffix.length() &&
+        s.compare(s.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+bool isBlankLine(string &line){
+    return line.find_first_not_of(" \t\r") == string::npos;
+}
+
+/*
+ *  Returns true if the given line opens a block, in which case the REPL
+ *  keeps reading lines until an empty line is entered.
+ */
+bool opensBlock(string &line){
+    string trimmed = line.substr(line.find_first_not_of(" \t"));
+    trimmed = trimmed.substr(0, trimmed.find_last_not_of(" \t\r") + 1);
+
+    for(auto &kw : replBlockStarts)
+        if(startsWith(trimmed, kw))
+            return true;
+
+    for(auto &kw : replBlockEnds)
+        if(endsWith(trimmed, kw))
+            return true;
+
+    return false;
+}
+
+
+/*
+ *  Reads the next input from stdin into input.  Only a single line is read
+ *  unless that line opens a block, in which case every line up to the next
+ *  empty line is read as well.  Returns false once stdin is exhausted.
+ */
+bool readReplInput(string &input){
+    string line;
+
+    do{
+        cout << ": " << flush;
+        if(!getline(cin, line)) return false;
+    }while(isBlankLine(line));
+
+    input = line + '\n';
+
+    if(opensBlock(line)){
+        while(true){
+            cout << ". " << flush;
+            if(!getline(cin, line) || isBlankLine(line)) break;
+            input += line + '\n';
+        }
+    }
+    return true;
+}
+
+
+/*
+ *  Parses a single REPL input, returning its root node or nullptr if
+ *  there was a syntax error.
+ */
+Node* parseReplInput(string &input){
+    setLexer(new Lexer("(repl)", input));
+    yy::parser p{};
+    int flag = p.parse();
+
+    delete yylexer;
+    yylexer = nullptr;
+    return flag == PE_OK ? parser::getRootNode() : nullptr;
+}
+
+
+/*
+ *  Returns true if a value of the given type can be returned from an
+ *  input's function for the REPL to print it.  These are the return
+ *  types supported by ExecutionEngine::runFunction.
+ */
+bool isPrintableReplType(TypedValue *tv){
+    TypeTag tt = tv->type->type;
+
+    if(tv->getType()->isVoidTy()) return false;
+
+    return isIntTypeTag(tt) || tt == TT_Bool || tt == TT_F32 || tt == TT_F64 ||
+           tt == TT_Ptr || tt == TT_Array || tv->type->typeName == "Str";
+}
+
+
+void printReplValue(GenericValue &gv, TypeNode *tyn){
+    TypeTag tt = tyn->type;
+
+    if(tt == TT_Void) return;
+
+    if(tt == TT_Bool)
+        cout << (gv.IntVal.getBoolValue() ? "true" : "false");
+    else if(tt == TT_C8)
+        cout << '\'' << (char)gv.IntVal.getZExtValue() << '\'';
+    else if(isIntTypeTag(tt))
+        cout << gv.IntVal.toString(10, !isUnsignedTypeTag(tt));
+    else if(tt == TT_F32)
+        cout << gv.FloatVal;
+    else if(tt == TT_F64)
+        cout << gv.DoubleVal;
+    else if(tyn->typeName == "Str")
+        cout << '"' << (char*)GVTOP(gv) << '"';
+    else if(tt == TT_Ptr || tt == TT_Array)
+        cout << GVTOP(gv);
+
+    cout << " : " << typeNodeToStr(tyn) << endl;
+}
+
+
+/*
+ *  Compiles a single REPL input into a fresh module, adds that module to the
+ *  JIT, then runs it and prints its value.  Variables, functions, and types
+ *  defined by previous inputs remain visible.
+ */
+void Compiler::eval(Node *input){
+    string fnName = "__repl" + to_string(++replLine);
+    module.reset(new Module(fnName, getGlobalContext()));
+    initPassManager();
+
+    if(ast)
+        replInputs.push_back(move(ast));
+    ast.reset(input);
+
+    //save the current definitions so they can be restored if this input fails to compile
+    auto globals = *varTable[0];
+    auto decls = fnDecls;
+    auto types = userTypes;
+    auto imports = importedDecls;
+
+    scanAllDecls();
+
+    //the input's return type is unknown until it is compiled, so compile it into a
+    //placeholder function then move its body to the real function afterward.
+    FunctionType *preFnTy = FunctionType::get(Type::getVoidTy(getGlobalContext()), false);
+    Function *preFn = Function::Create(preFnTy, Function::ExternalLinkage, "__repl_pre__", module.get());
+    builder.SetInsertPoint(BasicBlock::Create(getGlobalContext(), "entry", preFn));
+
+    TypedValue *v = ast->compile(this);
+
+    if(errFlag){
+        *varTable[0] = globals;
+        fnDecls = decls;
+        userTypes = types;
+        importedDecls = imports;
+        errFlag = false;
+        return;
+    }
+
+    //inputs consisting only of declarations have no value
+    if(!v) v = getVoidLiteral();
+
+    Value *retVal = nullptr;
+    if(isPrintableReplType(v)){
+        retVal = v->type->typeName == "Str" ? builder.CreateExtractValue(v->val, 0) : v->val;
+        builder.CreateRet(retVal);
+    }else{
+        builder.CreateRetVoid();
+    }
+
+    Type *retTy = retVal ? retVal->getType() : Type::getVoidTy(getGlobalContext());
+    Function *f = Function::Create(FunctionType::get(retTy, false), Function::ExternalLinkage, fnName, module.get());
+    f->getBasicBlockList().splice(f->begin(), preFn->getBasicBlockList());
+    preFn->eraseFromParent();
+    passManager->run(*f);
+
+    //only this input's module is given to the JIT, so the work done per input
+    //does not grow with the amount of previous definitions.
+    addModuleToJIT();
+
+    GenericValue res = jit->runFunction(f, vector<GenericValue>());
+    printReplValue(res, v->type.get());
+}
+
+
+void ante::startRepl(){
+    puts("Ante REPL, finish blocks with an empty line and exit with EOF (ctrl+d).");
+
+    Compiler c{(Node*)nullptr, "repl"};
+    c.isRepl = true;
+    c.compilePrelude();
+
+    string input;
+    while(readReplInput(input)){
+        if(Node *root = parseReplInput(input))
+            c.eval(root);
+    }
+    putchar('\n');
+}
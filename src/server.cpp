@@ -0,0 +1,252 @@
+/*
+ *      server.cpp
+ *  Persistent compile server used by ante --server and ante --client.
+ *  The server initializes LLVM, the TargetMachine, and the prelude's
+ *  interface once, then forks a worker for each request so that every
+ *  request starts from this warm state and a crashing or exiting compile
+ *  never takes down the server.  The client passes its stdin, stdout,
+ *  and stderr over the socket so diagnostics are written directly to
+ *  the client's terminal, then waits for the exit status of the request.
+ */
+#include "compiler.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <cstdint>
+
+using namespace ante;
+
+
+/*
+ *  Returns the path of the server's socket, which may be overridden
+ *  by setting ANTE_SOCKET.
+ */
+string getSocketPath(){
+    const char *path = getenv("ANTE_SOCKET");
+    return path ? path : "/tmp/ante-" + to_string(getuid()) + ".sock";
+}
+
+
+bool initSocketAddr(sockaddr_un &addr, string &path){
+    if(path.length() >= sizeof(addr.sun_path)){
+        cerr << "Socket path '" << path << "' is too long\n";
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+
+bool writeAll(int fd, const char *buf, size_t len){
+    while(len > 0){
+        ssize_t n = write(fd, buf, len);
+        if(n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+bool readAll(int fd, char *buf, size_t len){
+    while(len > 0){
+        ssize_t n = read(fd, buf, len);
+        if(n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+/*
+ *  Sends the length of a request along with the client's stdin, stdout, and stderr.
+ */
+bool sendRequestHeader(int sock, uint32_t len){
+    int fds[3] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    iovec iov = {&len, sizeof(len)};
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(sock, &msg, 0) == sizeof(len);
+}
+
+
+/*
+ *  Receives the length of a request along with the client's stdin, stdout, and stderr.
+ */
+bool recvRequestHeader(int sock, uint32_t &len, int fds[3]){
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+
+    iovec iov = {&len, sizeof(len)};
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if(recvmsg(sock, &msg, MSG_WAITALL) != sizeof(len))
+        return false;
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3))
+        return false;
+
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
+    return true;
+}
+
+
+/*
+ *  Handles a single request within its own process.  A request is the client's
+ *  working directory followed by its arguments, each null-terminated.  The
+ *  request is run in a worker forked from this process, and its exit status is
+ *  sent back to the client once it finishes.
+ */
+void handleRequest(int conn){
+    //the server ignores SIGCHLD so it need not reap handlers, but the handler
+    //must wait on its worker
+    signal(SIGCHLD, SIG_DFL);
+
+    uint32_t len;
+    int fds[3];
+    if(!recvRequestHeader(conn, len, fds))
+        _exit(1);
+
+    vector<char> request(len);
+    if(!readAll(conn, request.data(), len) || len == 0 || request.back() != '\0')
+        _exit(1);
+
+    vector<char*> args;
+    for(size_t i = 0; i < len; i += strlen(&request[i]) + 1)
+        args.push_back(&request[i]);
+
+    pid_t pid = fork();
+    if(pid == 0){
+        close(conn);
+        for(int i = 0; i < 3; i++){
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+
+        if(chdir(args[0])){
+            perror(args[0]);
+            exit(1);
+        }
+
+        //args[0] is the working directory, which takes the place of the program name
+        exit(runAnte(args.size(), args.data()));
+    }
+
+    int32_t status = 1;
+    int wstatus;
+    if(pid > 0 && waitpid(pid, &wstatus, 0) == pid && WIFEXITED(wstatus))
+        status = WEXITSTATUS(wstatus);
+
+    writeAll(conn, (char*)&status, sizeof(status));
+    _exit(0);
+}
+
+
+/*
+ *  Does the work shared by every request ahead of time, so that each worker
+ *  inherits it already done.
+ */
+void warmUp(){
+    getTargetMachine();
+
+    Compiler c{(Node*)nullptr, "server"};
+    c.compilePrelude();
+}
+
+
+int ante::startServer(){
+    string path = getSocketPath();
+    sockaddr_un addr;
+    if(!initSocketAddr(addr, path))
+        return 1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if(sock < 0 || bind(sock, (sockaddr*)&addr, sizeof(addr)) || listen(sock, 64)){
+        perror("ante --server");
+        return 1;
+    }
+
+    warmUp();
+
+    //handlers are never waited on, so let them be reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+    cout << "Ante: listening on " << path << endl;
+
+    while(true){
+        int conn = accept(sock, nullptr, nullptr);
+        if(conn < 0) continue;
+
+        //flush first so buffered output is not duplicated in the handler
+        fflush(stdout);
+        if(fork() == 0){
+            close(sock);
+            handleRequest(conn);
+        }
+        close(conn);
+    }
+}
+
+
+/*
+ *  Forwards args to a running server and returns the exit status of the request.
+ *  If no server is running, the request is run within this process instead.
+ */
+int ante::runClient(int argc, char *argv[]){
+    string path = getSocketPath();
+    sockaddr_un addr;
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(!initSocketAddr(addr, path) || sock < 0 || connect(sock, (sockaddr*)&addr, sizeof(addr))){
+        if(sock >= 0) close(sock);
+        return runAnte(argc, argv);
+    }
+
+    char cwd[PATH_MAX];
+    if(!getcwd(cwd, sizeof(cwd))){
+        perror("getcwd");
+        return 1;
+    }
+
+    string request = string(cwd) + '\0';
+    for(int i = 1; i < argc; i++)
+        request += string(argv[i]) + '\0';
+
+    int32_t status = 1;
+    if(!sendRequestHeader(sock, request.length()) ||
+            !writeAll(sock, request.c_str(), request.length()) ||
+            !readAll(sock, (char*)&status, sizeof(status))){
+        cerr << "Ante: lost connection to server\n";
+        status = 1;
+    }
+
+    close(sock);
+    return status;
+}
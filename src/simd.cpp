@@ -0,0 +1,295 @@
+/*
+ *      simd.cpp
+ *  Fixed-width simd vector types, named after their element type and number
+ *  of lanes, such as f32x4, i32x8, u8x16, or boolx4.  They lower to llvm
+ *  vector types, so arithmetic and comparisons between vectors, or between a
+ *  vector and a scalar splatted to every lane, operate on every lane at once.
+ *  Comparisons give a vector of bools which can be used as a mask.
+ *
+ *  A vector is created by casting a tuple of its lanes, f32x4(1.0, 2.0, 3.0, 4.0),
+ *  or a scalar to splat, f32x4 0.0.  Lanes are read and written with #, and
+ *  the remaining operations are methods that are created in each module the
+ *  first time they are used:
+ *
+ *      V.load: [E..] s -> V                loads the first lanes elements of s
+ *      V.store: V v, [E..] s               stores v to the first lanes elements of s
+ *      V.shuffle: V v, i32xN idx -> V      lane i of the result is lane idx#i of v
+ *      V.select: V v, boolxN mask, V w -> V  lane i is v#i if mask#i, otherwise w#i
+ *      V.sum, V.product, V.min, V.max: V v -> E   reduces every lane of v
+ *      boolxN.any, boolxN.all: boolxN m -> bool   true if any or all lanes are true
+ *
+ *  Array literals and Strs are converted to slices when passed to load and store,
+ *  and any other array or pointer may be sub-sliced, eg. i32x4.load (p#(i..i+4)).
+ *  A slice shorter than the vector traps rather than reading or writing past it.
+ *
+ *  Each method is marked always_inline, so once inlined a shuffle with constant
+ *  indices becomes a single llvm shufflevector.
+ */
+#include "compiler.h"
+
+/*
+ *  Returns the type of each lane of a vector, or the type itself if it is not a vector.
+ */
+TypeTag scalarTypeTag(TypeNode *t){
+    return t->type == TT_Vector ? t->extTy->type : t->type;
+}
+
+
+unsigned int getVectorLanes(TypeNode *vecTy){
+    TypeTag elemTy;
+    unsigned int lanes = 0;
+    parseVectorTypeName(vecTy->typeName, &elemTy, &lanes);
+    return lanes;
+}
+
+
+TypeNode* mkVectorTypeNode(TypeTag elemTy, unsigned int lanes){
+    auto *vecTy = mkAnonTypeNode(TT_Vector);
+    vecTy->typeName = typeTagToStr(elemTy) + "x" + to_string(lanes);
+    vecTy->extTy.reset(mkAnonTypeNode(elemTy));
+    return vecTy;
+}
+
+
+/*
+ *  Returns the type of a comparison between two values of type t,
+ *  which is a bool for scalars and a vector of bools for vectors.
+ */
+TypeNode* mkCmpTypeNode(TypeNode *t){
+    if(t->type == TT_Vector)
+        return mkVectorTypeNode(TT_Bool, getVectorLanes(t));
+    return mkAnonTypeNode(TT_Bool);
+}
+
+
+/*
+ *  Converts a scalar to the element type of vecTy.  Scalars of the element type
+ *  are always accepted, while numeric constants of other types are converted
+ *  so that literals such as 2 or 0.5 can be used with any vector.  Returns
+ *  nullptr if the scalar cannot be converted.
+ */
+Value* toVectorElem(Compiler *c, TypedValue *scalar, TypeNode *vecTy){
+    TypeNode *elemTy = vecTy->extTy.get();
+    if(*scalar->type == *elemTy)
+        return scalar->val;
+
+    TypeTag from = scalar->type->type;
+    TypeTag to = elemTy->type;
+    if(!dynamic_cast<Constant*>(scalar->val) || !isNumericTypeTag(from) || !isNumericTypeTag(to))
+        return nullptr;
+
+    Type *ty = c->typeNodeToLlvmType(elemTy);
+    if(isIntTypeTag(from) && isIntTypeTag(to))
+        return c->builder.CreateIntCast(scalar->val, ty, !isUnsignedTypeTag(from));
+    if(isFPTypeTag(from) && isFPTypeTag(to))
+        return c->builder.CreateFPCast(scalar->val, ty);
+    if(isIntTypeTag(from) && isFPTypeTag(to))
+        return isUnsignedTypeTag(from) ? c->builder.CreateUIToFP(scalar->val, ty) : c->builder.CreateSIToFP(scalar->val, ty);
+    return nullptr;
+}
+
+
+/*
+ *  Creates a vector of type vecTy from a tuple with a value for each
+ *  lane, or by splatting a scalar to every lane.
+ */
+TypedValue* Compiler::createVector(TypedValue *val, TypeNode *vecTy){
+    unsigned int lanes = getVectorLanes(vecTy);
+
+    if(*val->type == *vecTy)
+        return val;
+
+    if(val->type->type != TT_Tuple){
+        Value *elem = toVectorElem(this, val, vecTy);
+        if(!elem)
+            return compErr("Cannot splat a(n) " + typeNodeToStr(val->type.get()) + " to a(n) " +
+                    typeNodeToStr(vecTy), vecTy->loc);
+        return new TypedValue(builder.CreateVectorSplat(lanes, elem), deepCopyTypeNode(vecTy));
+    }
+
+    unsigned int n = 0;
+    for(auto *laneTy = val->type->extTy.get(); laneTy; laneTy = (TypeNode*)laneTy->next.get())
+        n++;
+
+    if(n != lanes)
+        return compErr(typeNodeToStr(vecTy) + " has " + to_string(lanes) + " lanes, but was given a tuple of " +
+                to_string(n) + " elements", vecTy->loc);
+
+    Value *vec = UndefValue::get(typeNodeToLlvmType(vecTy));
+    TypeNode *laneTy = val->type->extTy.get();
+
+    for(unsigned int i = 0; i < lanes; i++, laneTy = (TypeNode*)laneTy->next.get()){
+        auto *lane = new TypedValue(builder.CreateExtractValue(val->val, i), deepCopyTypeNode(laneTy));
+        Value *elem = toVectorElem(this, lane, vecTy);
+        if(!elem)
+            return compErr("Lane " + to_string(i) + " of " + typeNodeToStr(vecTy) + " must be a(n) " +
+                    typeNodeToStr(vecTy->extTy.get()) + ", but is a(n) " + typeNodeToStr(laneTy), vecTy->loc);
+
+        vec = builder.CreateInsertElement(vec, elem, builder.getInt32(i));
+    }
+
+    return new TypedValue(vec, deepCopyTypeNode(vecTy));
+}
+
+
+/*
+ *  Prepares the operands of a binary operator on a vector by splatting
+ *  a scalar operand.  Returns false and reports an error if the operands
+ *  are not both vectors of the same type after splatting.
+ */
+bool Compiler::matchVectorOperands(TypedValue **l, TypedValue **r, BinOpNode *op){
+    TypedValue **scalar = (*l)->type->type == TT_Vector ? r : l;
+    TypedValue *vec = (*l)->type->type == TT_Vector ? *l : *r;
+
+    if((*scalar)->type->type != TT_Vector){
+        Value *elem = toVectorElem(this, *scalar, vec->type.get());
+        if(elem)
+            *scalar = new TypedValue(builder.CreateVectorSplat(getVectorLanes(vec->type.get()), elem),
+                    deepCopyTypeNode(vec->type.get()));
+    }
+
+    if(*(*l)->type != *(*r)->type){
+        compErr("Operator " + Lexer::getTokStr(op->op) + " is not defined for types " +
+                typeNodeToStr((*l)->type.get()) + " and " + typeNodeToStr((*r)->type.get()), op->loc);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ *  Reduces each lane of v to one value with the given method, one of sum,
+ *  product, min, max, any, or all.
+ */
+Value* reduceLanes(IRBuilder<> &b, Value *v, TypeTag elemTy, unsigned int lanes, const string &method){
+    Value *acc = b.CreateExtractElement(v, b.getInt32(0));
+    bool isFP = isFPTypeTag(elemTy);
+    bool isUnsigned = isUnsignedTypeTag(elemTy);
+
+    for(unsigned int i = 1; i < lanes; i++){
+        Value *lane = b.CreateExtractElement(v, b.getInt32(i));
+
+        if(method == "sum"){
+            acc = isFP ? b.CreateFAdd(acc, lane) : b.CreateAdd(acc, lane);
+        }else if(method == "product"){
+            acc = isFP ? b.CreateFMul(acc, lane) : b.CreateMul(acc, lane);
+        }else if(method == "min"){
+            Value *lt = isFP ? b.CreateFCmpOLT(lane, acc) : isUnsigned ? b.CreateICmpULT(lane, acc) : b.CreateICmpSLT(lane, acc);
+            acc = b.CreateSelect(lt, lane, acc);
+        }else if(method == "max"){
+            Value *gt = isFP ? b.CreateFCmpOGT(lane, acc) : isUnsigned ? b.CreateICmpUGT(lane, acc) : b.CreateICmpSGT(lane, acc);
+            acc = b.CreateSelect(gt, lane, acc);
+        }else if(method == "any"){
+            acc = b.CreateOr(acc, lane);
+        }else{ //all
+            acc = b.CreateAnd(acc, lane);
+        }
+    }
+    return acc;
+}
+
+
+/*
+ *  Returns a pointer to the first lanes elements of slice as a pointer to
+ *  vecTy, trapping if the slice has fewer elements than that.
+ */
+Value* getLanesPtr(IRBuilder<> &b, Module *m, Value *slice, unsigned int lanes, Type *vecTy){
+    Function *f = b.GetInsertBlock()->getParent();
+    auto *tooShort = BasicBlock::Create(getGlobalContext(), "too_short", f);
+    auto *inBounds = BasicBlock::Create(getGlobalContext(), "in_bounds", f);
+
+    Value *len = b.CreateExtractValue(slice, 1);
+    b.CreateCondBr(b.CreateICmpULT(len, b.getInt64(lanes)), tooShort, inBounds);
+
+    b.SetInsertPoint(tooShort);
+    b.CreateCall(Intrinsic::getDeclaration(m, Intrinsic::trap));
+    b.CreateUnreachable();
+
+    b.SetInsertPoint(inBounds);
+    return b.CreateBitCast(b.CreateExtractValue(slice, 0), vecTy->getPointerTo());
+}
+
+
+/*
+ *  Returns the built-in method of a vector type with the given mangled name,
+ *  eg. f32x4_sum, creating it in the current module if it does not yet exist.
+ *  Returns nullptr if name is not that of a vector method.
+ */
+TypedValue* Compiler::getVectorMethod(string &name){
+    size_t sep = name.find('_');
+    if(sep == string::npos) return nullptr;
+
+    TypeTag elemTag;
+    unsigned int lanes;
+    if(!parseVectorTypeName(name.substr(0, sep), &elemTag, &lanes))
+        return nullptr;
+
+    string method = name.substr(sep + 1);
+    bool isBool = elemTag == TT_Bool;
+
+    auto *elemSlice = mkAnonTypeNode(TT_Slice);
+    elemSlice->extTy.reset(mkAnonTypeNode(elemTag));
+
+    //the return type followed by each parameter type
+    vector<TypeNode*> sig;
+    if(method == "load" && !isBool)
+        sig = {mkVectorTypeNode(elemTag, lanes), elemSlice};
+    else if(method == "store" && !isBool)
+        sig = {mkAnonTypeNode(TT_Void), mkVectorTypeNode(elemTag, lanes), elemSlice};
+    else if((method == "sum" || method == "product" || method == "min" || method == "max") && !isBool)
+        sig = {mkAnonTypeNode(elemTag), mkVectorTypeNode(elemTag, lanes)};
+    else if((method == "any" || method == "all") && isBool)
+        sig = {mkAnonTypeNode(TT_Bool), mkVectorTypeNode(elemTag, lanes)};
+    else if(method == "shuffle")
+        sig = {mkVectorTypeNode(elemTag, lanes), mkVectorTypeNode(elemTag, lanes), mkVectorTypeNode(TT_I32, lanes)};
+    else if(method == "select")
+        sig = {mkVectorTypeNode(elemTag, lanes), mkVectorTypeNode(elemTag, lanes), mkVectorTypeNode(TT_Bool, lanes),
+               mkVectorTypeNode(elemTag, lanes)};
+    else
+        return nullptr;
+
+    auto *fnTy = mkAnonTypeNode(TT_Function);
+    fnTy->extTy.reset(sig[0]);
+    for(size_t i = 1; i < sig.size(); i++)
+        sig[i-1]->next.reset(sig[i]);
+
+    if(Function *existing = module->getFunction(name))
+        return new TypedValue(existing, fnTy);
+
+    vector<Type*> paramTys;
+    for(size_t i = 1; i < sig.size(); i++)
+        paramTys.push_back(typeNodeToLlvmType(sig[i]));
+
+    auto *ft = FunctionType::get(typeNodeToLlvmType(sig[0]), paramTys, false);
+    Function *f = Function::Create(ft, Function::LinkOnceODRLinkage, name, module.get());
+    f->addFnAttr(Attribute::NoUnwind);
+    f->addFnAttr(Attribute::AlwaysInline);
+
+    vector<Value*> args;
+    for(auto &arg : f->args())
+        args.push_back(&arg);
+
+    IRBuilder<> b{BasicBlock::Create(getGlobalContext(), "entry", f)};
+    Type *vecTy = typeNodeToLlvmType(sig[method == "load" ? 0 : 1]);
+    unsigned int align = max(1u, getBitWidthOfTypeTag(elemTag) / 8u);
+
+    if(method == "load"){
+        b.CreateRet(b.CreateAlignedLoad(getLanesPtr(b, module.get(), args[0], lanes, vecTy), align));
+    }else if(method == "store"){
+        b.CreateAlignedStore(args[0], getLanesPtr(b, module.get(), args[1], lanes, vecTy), align);
+        b.CreateRetVoid();
+    }else if(method == "shuffle"){
+        Value *res = UndefValue::get(vecTy);
+        for(unsigned int i = 0; i < lanes; i++){
+            Value *idx = b.CreateExtractElement(args[1], b.getInt32(i));
+            res = b.CreateInsertElement(res, b.CreateExtractElement(args[0], idx), b.getInt32(i));
+        }
+        b.CreateRet(res);
+    }else if(method == "select"){
+        b.CreateRet(b.CreateSelect(args[1], args[0], args[2]));
+    }else{
+        b.CreateRet(reduceLanes(b, args[0], elemTag, lanes, method));
+    }
+
+    return new TypedValue(f, fnTy);
+}
@@ -0,0 +1,302 @@
+/*
+ *      slice.cpp
+ *  Slices, written [T..], are a pointer to their first element along with
+ *  their length as a u64.  They are created by casting a value of known
+ *  length, such as an array literal or a Str, to a slice, or by the
+ *  sub-slice operator x#(start..end) which works on any array, pointer,
+ *  Str, or slice.  A slice's elements are accessed with # and iterated
+ *  over with for loops, and its fields ptr and len may be read directly.
+ *
+ *  Since the length of a slice is known, comparing slices is done with
+ *  memcmp and assigning one slice to a sub-slice of another with memmove,
+ *  rather than with a loop over each element.
+ */
+#include "compiler.h"
+
+TypeNode* mkSliceTypeNode(TypeNode *elemTy){
+    auto *tyn = mkAnonTypeNode(TT_Slice);
+    tyn->extTy.reset(deepCopyTypeNode(elemTy));
+    return tyn;
+}
+
+
+/*
+ *  Returns the length of an array literal, or nullptr if arr is not one.
+ *  Array literals are pointers to the first element of their storage, an
+ *  alloca or in the repl a mutable global, so their length is the length of
+ *  the llvm array type they index into.  String constants and pointers to
+ *  any later element are not array literals, as that length would include
+ *  their null terminator or the elements before them.
+ */
+Value* getArrayLength(Value *arr){
+    auto *gep = dyn_cast<GEPOperator>(arr);
+    if(!gep || !gep->hasAllZeroIndices()) return nullptr;
+
+    Value *storage = gep->getPointerOperand();
+    auto *global = dyn_cast<GlobalVariable>(storage);
+    if(!isa<AllocaInst>(storage) && !(global && !global->isConstant()))
+        return nullptr;
+
+    auto *arrTy = dyn_cast<ArrayType>(gep->getPointerOperandType()->getPointerElementType());
+    if(!arrTy) return nullptr;
+
+    return ConstantInt::get(Type::getInt64Ty(getGlobalContext()), arrTy->getNumElements());
+}
+
+
+/*
+ *  Gets the pointer to the first element of an array, pointer, Str, or slice,
+ *  along with its length as a u64 if it is known and its element type.
+ *  Returns false if val is none of these.
+ */
+bool getElements(Compiler *c, TypedValue *val, Value **ptr, Value **len, TypeNode **elemTy){
+    switch(val->type->type){
+        case TT_Slice:
+            *ptr = c->builder.CreateExtractValue(val->val, 0);
+            *len = c->builder.CreateExtractValue(val->val, 1);
+            *elemTy = val->type->extTy.get();
+            return true;
+        case TT_Array: case TT_Ptr:
+            *ptr = val->val;
+            *len = getArrayLength(val->val);
+            *elemTy = val->type->extTy.get();
+            return true;
+        case TT_Data:
+            if(val->type->typeName != "Str") return false;
+            *ptr = c->builder.CreateExtractValue(val->val, 0);
+            *len = c->builder.CreateZExt(c->builder.CreateExtractValue(val->val, 1), Type::getInt64Ty(getGlobalContext()));
+            *elemTy = mkAnonTypeNode(TT_C8);
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+Value* createSlice(Compiler *c, Value *ptr, Value *len){
+    auto *sliceTy = StructType::get(getGlobalContext(), {ptr->getType(), Type::getInt64Ty(getGlobalContext())});
+    auto *slice = c->builder.CreateInsertValue(UndefValue::get(sliceTy), ptr, 0);
+    return c->builder.CreateInsertValue(slice, len, 1);
+}
+
+
+/*
+ *  Converts an integer index to a u64, or returns nullptr if it is not an integer.
+ */
+Value* indexToU64(Compiler *c, TypedValue *index){
+    if(!isIntTypeTag(index->type->type)) return nullptr;
+    return c->builder.CreateIntCast(index->val, Type::getInt64Ty(getGlobalContext()),
+            !isUnsignedTypeTag(index->type->type));
+}
+
+
+/*
+ *  Converts a Str, array literal, or slice to a slice of its entire contents.
+ *  Returns nullptr if val is not one of these or its length is unknown.
+ */
+TypedValue* Compiler::toSlice(TypedValue *val){
+    if(val->type->type == TT_Slice) return val;
+
+    Value *ptr, *len;
+    TypeNode *elemTy;
+    if(!getElements(this, val, &ptr, &len, &elemTy) || !len)
+        return nullptr;
+
+    return new TypedValue(createSlice(this, ptr, len), mkSliceTypeNode(elemTy));
+}
+
+
+/*
+ *  Compiles the sub-slice operator val#(start..end), giving the slice of
+ *  each element of val from start up to but excluding end.
+ */
+TypedValue* Compiler::compSubSlice(TypedValue *val, BinOpNode *range){
+    Value *ptr, *len;
+    TypeNode *elemTy;
+    if(!getElements(this, val, &ptr, &len, &elemTy))
+        return compErr("Only arrays, pointers, Strs, and slices can be sliced, but this is a(n) " +
+                typeNodeToStr(val->type.get()), range->loc);
+
+    auto *start = range->lval->compile(this);
+    auto *end = range->rval->compile(this);
+    if(!start || !end) return 0;
+
+    Value *startIdx = indexToU64(this, start);
+    Value *endIdx = indexToU64(this, end);
+    if(!startIdx || !endIdx)
+        return compErr("The bounds of a slice must be integers, but are " + typeNodeToStr(start->type.get()) +
+                " and " + typeNodeToStr(end->type.get()), range->loc);
+
+    Value *subPtr = builder.CreateInBoundsGEP(ptr->getType()->getPointerElementType(), ptr, startIdx);
+    Value *subLen = builder.CreateSub(endIdx, startIdx);
+    return new TypedValue(createSlice(this, subPtr, subLen), mkSliceTypeNode(elemTy));
+}
+
+
+/*
+ *  Compiles an assignment to an element of a slice, slice#i = val, or to a
+ *  sub-slice of any array, pointer, or slice, x#(start..end) = slice, which
+ *  copies each element of slice into x from start up to but excluding end.
+ */
+TypedValue* Compiler::compSliceInsert(TypedValue *val, BinOpNode *insertOp, Node *assignExpr){
+    auto *range = dynamic_cast<BinOpNode*>(insertOp->rval.get());
+
+    //assignment to a single element
+    if(!range || range->op != Tok_Range){
+        auto *index = insertOp->rval->compile(this);
+        auto *newVal = assignExpr->compile(this);
+        if(!index || !newVal) return 0;
+
+        Value *idx = indexToU64(this, index);
+        if(!idx)
+            return compErr("Index of a slice must be an integer, but is a(n) " + typeNodeToStr(index->type.get()),
+                    insertOp->rval->loc);
+
+        if(*val->type->extTy != *newVal->type)
+            return compErr("Cannot store a(n) " + typeNodeToStr(newVal->type.get()) + " into a(n) " +
+                    typeNodeToStr(val->type.get()), assignExpr->loc);
+
+        Value *ptr = builder.CreateExtractValue(val->val, 0);
+        builder.CreateStore(newVal->val, builder.CreateInBoundsGEP(ptr->getType()->getPointerElementType(), ptr, idx));
+        return getVoidLiteral();
+    }
+
+    auto *dest = compSubSlice(val, range);
+    if(!dest) return 0;
+
+    auto *src = assignExpr->compile(this);
+    if(!src) return 0;
+
+    auto *srcSlice = toSlice(src);
+    if(!srcSlice)
+        return compErr("Only slices or values of known length can be assigned to a slice, but this is a(n) " +
+                typeNodeToStr(src->type.get()), assignExpr->loc);
+
+    if(*srcSlice->type != *dest->type)
+        return compErr("Cannot assign a(n) " + typeNodeToStr(srcSlice->type.get()) + " to a(n) " +
+                typeNodeToStr(dest->type.get()), assignExpr->loc);
+
+    Value *destPtr = builder.CreateExtractValue(dest->val, 0);
+    Value *srcPtr = builder.CreateExtractValue(srcSlice->val, 0);
+    Value *len = builder.CreateExtractValue(dest->val, 1);
+    Value *srcLen = builder.CreateExtractValue(srcSlice->val, 1);
+
+    //lengths known when compiling are checked then, others trap when they differ at runtime
+    auto *constLen = dyn_cast<ConstantInt>(len);
+    auto *constSrcLen = dyn_cast<ConstantInt>(srcLen);
+    if(constLen && constSrcLen){
+        if(constLen->getZExtValue() != constSrcLen->getZExtValue())
+            return compErr("Cannot assign a slice of length " + to_string(constSrcLen->getZExtValue()) +
+                    " to a slice of length " + to_string(constLen->getZExtValue()), assignExpr->loc);
+    }else{
+        Function *f = builder.GetInsertBlock()->getParent();
+        BasicBlock *mismatch = BasicBlock::Create(getGlobalContext(), "slice_len_mismatch", f);
+        BasicBlock *copy = BasicBlock::Create(getGlobalContext(), "slice_copy", f);
+        builder.CreateCondBr(builder.CreateICmpEQ(len, srcLen), copy, mismatch);
+
+        builder.SetInsertPoint(mismatch);
+        builder.CreateCall(Intrinsic::getDeclaration(module.get(), Intrinsic::trap));
+        builder.CreateUnreachable();
+        builder.SetInsertPoint(copy);
+    }
+
+    //the source may be another part of the same array, so the copy must allow overlap
+    Type *elemTy = destPtr->getType()->getPointerElementType();
+    Value *bytes = builder.CreateMul(len, ConstantExpr::getSizeOf(elemTy));
+    builder.CreateMemMove(destPtr, srcPtr, bytes, 1);
+    return getVoidLiteral();
+}
+
+
+/*
+ *  Compiles == or != of two slices, or of a slice and a value that can be
+ *  converted to one.  Slices are equal if they have the same length and
+ *  their elements compare equal with memcmp, so only slices of integers,
+ *  chars, and bools can be compared.
+ */
+TypedValue* Compiler::compSliceEq(TypedValue *l, TypedValue *r, BinOpNode *op){
+    auto *ls = toSlice(l);
+    auto *rs = toSlice(r);
+    if(!ls || !rs || *ls->type != *rs->type)
+        return compErr("Cannot compare a(n) " + typeNodeToStr(l->type.get()) + " with a(n) " +
+                typeNodeToStr(r->type.get()), op->loc);
+
+    TypeTag elemTag = ls->type->extTy->type;
+    if(!isIntTypeTag(elemTag) && elemTag != TT_Bool)
+        return compErr("Only slices of integers, chars, and bools can be compared, but these are " +
+                typeNodeToStr(ls->type.get()), op->loc);
+
+    Value *lPtr = builder.CreateExtractValue(ls->val, 0);
+    Value *rPtr = builder.CreateExtractValue(rs->val, 0);
+    Value *lLen = builder.CreateExtractValue(ls->val, 1);
+    Value *rLen = builder.CreateExtractValue(rs->val, 1);
+
+    Function *f = builder.GetInsertBlock()->getParent();
+    BasicBlock *lenCheck = builder.GetInsertBlock();
+    BasicBlock *cmpElems = BasicBlock::Create(getGlobalContext(), "slice_cmp", f);
+    BasicBlock *merge = BasicBlock::Create(getGlobalContext(), "slice_eq", f);
+
+    //the elements are only compared if the lengths match
+    builder.CreateCondBr(builder.CreateICmpEQ(lLen, rLen), cmpElems, merge);
+
+    builder.SetInsertPoint(cmpElems);
+    auto *i8PtrTy = Type::getInt8PtrTy(getGlobalContext());
+    auto *i64Ty = Type::getInt64Ty(getGlobalContext());
+    auto *memcmpTy = FunctionType::get(Type::getInt32Ty(getGlobalContext()), {i8PtrTy, i8PtrTy, i64Ty}, false);
+    Constant *memcmpFn = module->getOrInsertFunction("memcmp", memcmpTy);
+
+    Value *bytes = builder.CreateMul(lLen, ConstantExpr::getSizeOf(lPtr->getType()->getPointerElementType()));
+    Value *cmp = builder.CreateCall(memcmpFn, {builder.CreateBitCast(lPtr, i8PtrTy), builder.CreateBitCast(rPtr, i8PtrTy), bytes});
+    Value *elemsEq = builder.CreateICmpEQ(cmp, builder.getInt32(0));
+    builder.CreateBr(merge);
+
+    builder.SetInsertPoint(merge);
+    auto *eq = builder.CreatePHI(Type::getInt1Ty(getGlobalContext()), 2);
+    eq->addIncoming(builder.getFalse(), lenCheck);
+    eq->addIncoming(elemsEq, cmpElems);
+
+    Value *res = op->op == Tok_Eq ? (Value*)eq : builder.CreateNot(eq);
+    return new TypedValue(res, mkAnonTypeNode(TT_Bool));
+}
+
+
+/*
+ *  Compiles a for loop over each element of a slice, which is
+ *  compiled as a counted loop over the slice's indices.
+ */
+TypedValue* Compiler::compForSlice(ForNode *fn, TypedValue *slice){
+    Value *ptr = builder.CreateExtractValue(slice->val, 0);
+    Value *len = builder.CreateExtractValue(slice->val, 1);
+
+    Function *f = builder.GetInsertBlock()->getParent();
+    BasicBlock *preheader = builder.GetInsertBlock();
+    BasicBlock *cond   = BasicBlock::Create(getGlobalContext(), "for_cond", f);
+    BasicBlock *begin  = BasicBlock::Create(getGlobalContext(), "for", f);
+    BasicBlock *latch  = BasicBlock::Create(getGlobalContext(), "for_next", f);
+    BasicBlock *endFor = BasicBlock::Create(getGlobalContext(), "end_for", f);
+
+    builder.CreateBr(cond);
+    builder.SetInsertPoint(cond);
+    PHINode *i = builder.CreatePHI(len->getType(), 2, "idx");
+    i->addIncoming(builder.getInt64(0), preheader);
+    builder.CreateCondBr(builder.CreateICmpULT(i, len), begin, endFor);
+
+    builder.SetInsertPoint(begin);
+    enterNewScope();
+    auto *elem = new TypedValue(builder.CreateLoad(builder.CreateInBoundsGEP(ptr->getType()->getPointerElementType(), ptr, i)), deepCopyTypeNode(slice->type->extTy.get()));
+    stoVar(fn->var, new Variable(fn->var, elem, scope));
+    auto *val = fn->child->compile(this); //compile the for loop's body
+    exitScope();
+
+    if(!val) return 0;
+    if(!dynamic_cast<ReturnInst*>(val->val))
+        builder.CreateBr(latch);
+
+    //i < len, so incrementing i never overflows
+    builder.SetInsertPoint(latch);
+    i->addIncoming(builder.CreateNUWAdd(i, builder.getInt64(1)), latch);
+    builder.CreateBr(cond);
+
+    builder.SetInsertPoint(endFor);
+    return getVoidLiteral();
+}
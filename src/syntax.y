@@ -36,7 +36,7 @@ void yyerror(const char *msg);
 %token I8 I16 I32 I64 
 %token U8 U16 U32 U64
 %token Isz Usz F16 F32 F64
-%token C8 C32 Bool Void
+%token C8 C32 Bool Void VecType
 
 /* operators */
 %token Eq NotEq AddEq SubEq MulEq DivEq GrtrEq LesrEq
@@ -107,7 +107,7 @@ void yyerror(const char *msg);
 
 %nonassoc '!'
 %left '@' New Not
-%left '&' TYPE UserType TypeVar I8 I16 I32 I64 U8 U16 U32 U64 Isz Usz F16 F32 F64 C8 C32 Bool Void Type '\''
+%left '&' TYPE UserType TypeVar I8 I16 I32 I64 U8 U16 U32 U64 Isz Usz F16 F32 F64 C8 C32 Bool Void VecType Type '\''
 %nonassoc FUNC
 
 %nonassoc LITERALS StrLit IntLit FltLit CharLit True False Ident
@@ -155,6 +155,9 @@ usertype: UserType {$$ = (Node*)lextxt;}
 typevar: TypeVar {$$ = (Node*)lextxt;}
        ;
 
+vectype: VecType {$$ = (Node*)lextxt;}
+       ;
+
 intlit: IntLit {$$ = mkIntLitNode(@$, lextxt);}
       ;
 
@@ -186,10 +189,12 @@ lit_type: I8        {$$ = mkTypeNode(@$, TT_I8,  (char*)"");}
         | Void      {$$ = mkTypeNode(@$, TT_Void, (char*)"");}
         | usertype  {$$ = mkTypeNode(@$, TT_Data, (char*)$1);}
         | typevar   {$$ = mkTypeNode(@$, TT_TypeVar, (char*)$1);}
+        | vectype   {$$ = mkVecTypeNode(@$, (char*)$1);}
         ;
 
 type: type '*'              %prec HIGH {$$ = mkTypeNode(@$, TT_Ptr,  (char*)"", $1);}
     | '[' type_expr ']'     {$$ = mkTypeNode(@$, TT_Array,(char*)"", $2);}
+    | '[' type_expr Range ']' {$$ = mkTypeNode(@$, TT_Slice,(char*)"", $2);}
     | type '>' type         {setNext($3, $1); $$ = mkTypeNode(@$, TT_Function, (char*)"", $3);}  /* f-ptr w/ params*/
     | '(' ')' RArrow type   {$$ = mkTypeNode(@$, TT_Function, (char*)"", $4);}  /* f-ptr w/out params*/
     | '(' type_expr ')'     {$$ = $2;}
@@ -0,0 +1,187 @@
+/*
+ *      timing.cpp
+ *  Phase timing used by --time-report and --time-trace.  Each phase of a
+ *  compilation is timed as a span, and spans nest: the span of a lazily
+ *  compiled function contains the spans of every function and import it
+ *  caused to be compiled.  --time-report prints the time spent within each
+ *  phase excluding its nested spans, while --time-trace writes every span
+ *  in Chrome's trace event format, viewable in chrome://tracing.
+ *
+ *  Lexing is interleaved with parsing, so rather than a span per token the
+ *  time of each token is only added to the totals of the Lex phase.
+ */
+#include "timing.h"
+#include <unistd.h>
+#include <cstdio>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace ante::timing;
+
+bool ante::timing::enabled = false;
+
+
+struct OpenSpan {
+    const char *phase;
+    string name;
+    Clock::time_point start;
+
+    //time spent within this span's nested spans
+    Clock::duration childTime;
+
+    OpenSpan(const char *p, const string &n) : phase(p), name(n), start(Clock::now()), childTime(0){}
+};
+
+
+struct TraceEvent {
+    const char *phase;
+    string name;
+    Clock::time_point start;
+    Clock::duration duration;
+
+    TraceEvent(const char *p, string &n, Clock::time_point s, Clock::duration d) : phase(p), name(n), start(s), duration(d){}
+};
+
+
+struct PhaseTotal {
+    unsigned long count;
+    Clock::duration selfTime;
+
+    PhaseTotal() : count(0), selfTime(0){}
+};
+
+
+long long toMicroseconds(Clock::duration d){
+    return chrono::duration_cast<chrono::microseconds>(d).count();
+}
+
+
+/*
+ *  Writes s as a json string.
+ */
+void writeJsonString(FILE *f, const string &s){
+    fputc('"', f);
+    for(char c : s){
+        if(c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if((unsigned char)c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+
+/*
+ *  Spans of the current compilation.  The report and trace are written
+ *  when the compiler exits, after closing any spans still open if it
+ *  exited early, such as on a compilation error.
+ */
+struct TimingState {
+    bool report;
+    string traceFile;
+    Clock::time_point processStart;
+
+    vector<OpenSpan> open;
+    vector<TraceEvent> events;
+    map<string, PhaseTotal> totals;
+
+    TimingState() : report(false), processStart(Clock::now()){}
+
+    void addTime(const char *phase, Clock::duration duration, Clock::duration childTime){
+        auto &total = totals[phase];
+        total.count++;
+        total.selfTime += duration - childTime;
+
+        if(!open.empty())
+            open.back().childTime += duration;
+    }
+
+    void printReport(Clock::duration wallTime){
+        vector<pair<string, PhaseTotal>> phases{totals.begin(), totals.end()};
+        sort(phases.begin(), phases.end(), [](const pair<string, PhaseTotal> &l, const pair<string, PhaseTotal> &r){
+            return l.second.selfTime > r.second.selfTime;
+        });
+
+        double wallMs = toMicroseconds(wallTime) / 1000.0;
+        fprintf(stderr, "===--- Ante Time Report ---===\n");
+        fprintf(stderr, "%12s %8s %10s  %s\n", "Self (ms)", "Share", "Count", "Phase");
+
+        for(auto &p : phases){
+            double ms = toMicroseconds(p.second.selfTime) / 1000.0;
+            fprintf(stderr, "%12.3f %7.1f%% %10lu  %s\n", ms, wallMs > 0 ? ms / wallMs * 100 : 0, p.second.count, p.first.c_str());
+        }
+        fprintf(stderr, "%12.3f %7.1f%% %10s  %s\n", wallMs, 100.0, "", "Total");
+    }
+
+    void writeTrace(){
+        FILE *f = fopen(traceFile.c_str(), "w");
+        if(!f){
+            perror(traceFile.c_str());
+            return;
+        }
+
+        fputs("{\"traceEvents\":[\n", f);
+        for(size_t i = 0; i < events.size(); i++){
+            auto &e = events[i];
+            fputs("{\"name\":", f);
+            writeJsonString(f, e.name.empty() ? e.phase : e.name);
+            fputs(",\"cat\":", f);
+            writeJsonString(f, e.phase);
+            fprintf(f, ",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":0}%s\n",
+                    toMicroseconds(e.start - processStart), toMicroseconds(e.duration),
+                    (int)getpid(), i + 1 < events.size() ? "," : "");
+        }
+        fputs("],\"displayTimeUnit\":\"ms\"}\n", f);
+        fclose(f);
+    }
+
+    ~TimingState(){
+        if(!enabled) return;
+
+        while(!open.empty())
+            endSpan();
+
+        if(report) printReport(Clock::now() - processStart);
+        if(!traceFile.empty()) writeTrace();
+    }
+} state;
+
+
+void ante::timing::enableReport(){
+    enabled = true;
+    state.report = true;
+}
+
+
+void ante::timing::enableTrace(const string &traceFile){
+    enabled = true;
+    state.traceFile = traceFile;
+}
+
+
+void ante::timing::beginSpan(const char *phase, const string &name){
+    state.open.emplace_back(phase, name);
+}
+
+
+void ante::timing::endSpan(){
+    if(state.open.empty()) return;
+
+    OpenSpan span = state.open.back();
+    state.open.pop_back();
+
+    auto duration = Clock::now() - span.start;
+    state.addTime(span.phase, duration, span.childTime);
+
+    if(!state.traceFile.empty())
+        state.events.emplace_back(span.phase, span.name, span.start, duration);
+}
+
+
+/*
+ *  Adds the time since start, taken just before lexing a token, to the Lex phase.
+ */
+void ante::timing::addLexTime(Clock::time_point start){
+    state.addTime("Lex", Clock::now() - start, Clock::duration(0));
+}
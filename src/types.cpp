@@ -40,6 +40,10 @@ unsigned int TypeNode::getSizeInBits(Compiler *c){
         }
     }else if(type == TT_Array || type == TT_Ptr || type == TT_Function || type == TT_Method){
         return 64;
+    }else if(type == TT_Slice){
+        return 128;
+    }else if(type == TT_Vector){
+        return ext->getSizeInBits(c) * getVectorLanes(this);
     }
     
     return total;
@@ -282,6 +286,12 @@ Type* Compiler::typeNodeToLlvmType(TypeNode *tyNode){
                 : Type::getInt8Ty(getGlobalContext())->getPointerTo();
         case TT_Array:
             return PointerType::get(typeNodeToLlvmType(tyn), 0);
+        case TT_Vector:
+            return VectorType::get(typeNodeToLlvmType(tyn), getVectorLanes(tyNode));
+        case TT_Slice:
+            tys.push_back(PointerType::get(typeNodeToLlvmType(tyn), 0));
+            tys.push_back(Type::getInt64Ty(getGlobalContext()));
+            return StructType::get(getGlobalContext(), tys);
         case TT_Tuple:
             while(tyn){
                 tys.push_back(typeNodeToLlvmType(tyn));
@@ -400,7 +410,9 @@ bool TypeNode::operator==(TypeNode &r) const {
             return true;
 
         return *this->extTy.get() == *r.extTy.get();
-    }else if(r.type == TT_Data || r.type == TT_TaggedUnion){
+    }else if(r.type == TT_Slice){
+        return *this->extTy.get() == *r.extTy.get();
+    }else if(r.type == TT_Data || r.type == TT_TaggedUnion || r.type == TT_Vector){
         return typeName == r.typeName;
     }else if(r.type == TT_Function || r.type == TT_Method || r.type == TT_Tuple){
         return extTysEq(this, &r);
@@ -460,6 +472,8 @@ string typeTagToStr(TypeTag ty){
          */
         case TT_Tuple:       return "Tuple";
         case TT_Array:       return "Array";
+        case TT_Slice:       return "Slice";
+        case TT_Vector:      return "Vector";
         case TT_Ptr:         return "Ptr"  ;
         case TT_Data:        return "Data" ;
         case TT_Function:    return "Function";
@@ -485,10 +499,12 @@ string typeNodeToStr(TypeNode *t){
             elem = (TypeNode*)elem->next.get();
         }
         return ret;
-    }else if(t->type == TT_Data || t->type == TT_TaggedUnion){
+    }else if(t->type == TT_Data || t->type == TT_TaggedUnion || t->type == TT_Vector){
         return t->typeName;
     }else if(t->type == TT_Array){
         return '[' + typeNodeToStr(t->extTy.get()) + ']';
+    }else if(t->type == TT_Slice){
+        return '[' + typeNodeToStr(t->extTy.get()) + "..]";
     }else if(t->type == TT_Ptr){
         return typeNodeToStr(t->extTy.get()) + "*";
     }else if(t->type == TT_Function || t->type == TT_Method){